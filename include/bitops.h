@@ -1,3 +1,6 @@
+#ifndef BITOPS_H
+#define BITOPS_H
+
 #ifdef CONFIG_64BIT
 #define BITS_PER_LONG 64
 #else
@@ -14,7 +17,7 @@
 #define BIT_ULL_MASK(nr)        (1ULL << ((nr) % BITS_PER_LONG_LONG))
 #define BIT_ULL_WORD(nr)        ((nr) / BITS_PER_LONG_LONG)
 
-#define BITS_TO_LONGS(nr)       DIV_ROUND_UP(nr, BITS_PER_BYTE * sizeof(long))
+#define BITS_TO_LONGS(nr)       DIV_ROUND_UP(nr, BITS_PER_LONG)
 
 #define BIT_ULL_MASK(nr)        (1ULL << ((nr) % BITS_PER_LONG_LONG))
 #define BIT_ULL_WORD(nr)        ((nr) / BITS_PER_LONG_LONG)
@@ -35,3 +38,32 @@
 #define NBITS(n) (n==0?0:NBITS32(n))
 
 #define EXTRACT_NBITS(nr, h, l) ((nr&GENMASK(h,l)) >> l)
+
+/*
+ * Bitmap helpers, the word layout follows BIT_WORD()/BIT_MASK() so a
+ * bitmap of @nr bits is declared as unsigned long map[BITS_TO_LONGS(nr)]
+ */
+static inline void set_bit(int nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] |= BIT_MASK(nr);
+}
+
+static inline void clear_bit(int nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] &= ~BIT_MASK(nr);
+}
+
+static inline int test_bit(int nr, const unsigned long *addr)
+{
+	return (addr[BIT_WORD(nr)] & BIT_MASK(nr)) != 0;
+}
+
+/*
+ * __ffs - index of the lowest set bit of a non-zero word
+ */
+static inline int __ffs(unsigned long word)
+{
+	return __builtin_ctzl(word);
+}
+
+#endif /* BITOPS_H */
@@ -14,6 +14,8 @@
 #include "os-mm.h"
 #endif
 
+#include "rbtree.h"
+
 #define ADDRESS_SIZE 20
 #define OFFSET_LEN 10
 #define FIRST_LV_LEN 5
@@ -92,6 +94,36 @@ struct pcb_t
 	// TODO: Tự thêm
 	int remaining_time;
 
+	uint32_t base_prio;	   // prio as loaded, restored after aging
+
+	// EDF class: absolute deadline slot, 0 if the process has none
+	uint64_t deadline;
+
+	// CPUs the process may run on, bit i for CPU i, 0 for any CPU
+	unsigned long affinity;
+	int last_cpu;		   // CPU of the last dispatch, -1 before the first
+	unsigned long nr_migrations; // Dispatches on another CPU than last_cpu
+
+	int group;		   // Bandwidth group id, 0 for none
+	int quantum;		   // Adaptive quantum, 0 until the first dispatch
+	unsigned long nr_switches; // Times the process was put back preempted
+
+	// Scheduler accounting, in time slots
+	uint64_t arrival_time;	   // Slot the process was admitted
+	uint64_t enqueue_time;	   // Slot the process entered the ready queue
+	uint64_t aged_at;	   // Slot the process entered its current MLQ level
+	uint64_t exec_start;	   // Slot of the last dispatch
+	uint64_t first_run;	   // Slot of the first dispatch
+	uint64_t sum_exec_runtime; // Slots run so far
+	uint64_t sum_wait_time;	   // Slots spent queued, up to each dispatch
+	// CFS policy: weighted virtual runtime and run queue tree linkage
+	uint64_t vruntime;
+	struct rb_node run_node;
+	// MLFQ policy: current level, 0 is the highest
+	int mlfq_level;
+	// Stride policy: share of the CPU and virtual time of the next run
+	int tickets;		   // 0 until derived from prio
+	uint64_t pass;
 #endif
 #ifdef MM_PAGING
 	struct mm_struct *mm;
@@ -99,6 +131,7 @@ struct pcb_t
 	struct memphy_struct **mswp;
 	struct memphy_struct *active_mswp;
 	uint32_t active_mswp_id;
+	int resident;			 // Counted by the medium-term swapper
 #endif
 	struct page_table_t *page_table; // Page table
 	uint32_t bp;			 // Break pointer
@@ -0,0 +1,50 @@
+#ifndef LOG_H
+#define LOG_H
+
+/*
+ *  Buffered simulator output
+ *  Every thread appends its lines to a buffer of its own, tagged with the
+ *  time slot and the thread, without any lock. A line is stored as its
+ *  format and raw arguments. A background writer formats and writes the
+ *  lines to stdout once a slot is over, so the lines of a slot come out
+ *  together: the "Time slot" line first, then the loader, then CPU 0 to
+ *  N - 1, each in the order it wrote them.
+ *
+ *  Before log_init() and after log_finish(), lines go to stdout at once.
+ */
+
+#include <stdint.h>
+
+enum log_cat
+{
+	LOG_TIME,	// Time slot lines
+	LOG_SCHED,	// Loader and CPU events
+	LOG_MEM,	// Memory errors and memory system calls
+	LOG_DUMP,	// IODUMP of each memory operation: header, page tables
+			// and physical memory
+	LOG_NR_CATS,
+};
+
+/* Thread ids, records of one slot come out by id */
+#define LOG_ID_LOADER 1
+#define LOG_ID_CPU(cpu) (2 + (cpu))
+
+/* Start the writer */
+void log_init(void);
+
+/* Write out every line left and stop the writer */
+void log_finish(void);
+
+/* Name the calling thread for ordering, see LOG_ID_* */
+void log_thread(int id);
+
+/* Turn the categories of a comma separated list of names on, the others
+ * off. Return -1 on an unknown name */
+int log_select(const char *names);
+
+/* Queue a line of category [cat]. [fmt] must be a string literal, it is
+ * read again when the line is written out. %n is not supported */
+void log_printf(enum log_cat cat, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef MEMTRACE_H
+#define MEMTRACE_H
+
+/*
+ *  Memory event trace
+ *  Instead of printing the IODUMP text after every alloc, free, read and
+ *  write, the memory module appends fixed-size records to a memory-mapped
+ *  file: one record per operation, plus one per change to the state the
+ *  text dumps show (a page table entry, the end of vma 0, a byte of
+ *  MEMRAM). memtrace-dump replays the changes and prints the dump of any
+ *  operation on demand.
+ *
+ *  File layout: one struct memtrace_header, then struct memtrace_rec
+ *  records in the order they were written. Records of one process are in
+ *  program order, records of different processes are interleaved as
+ *  their CPUs wrote them.
+ */
+
+#include "common.h"
+#include <stdint.h>
+
+#define MEMTRACE_MAGIC "MEMT"
+#define MEMTRACE_VERSION 1
+
+enum memtrace_op {
+	MTRACE_ALLOC = 1,	// region allocated at vaddr, value: size
+	MTRACE_FREE,		// region about to be freed
+	MTRACE_READ,		// value: byte read, arg: offset in the region
+	MTRACE_WRITE,		// value: byte written, arg: offset in the region
+	MTRACE_PTE,		// entry pgn of the page table set to value
+	MTRACE_BRK,		// end of vma 0 moved to value
+	MTRACE_BYTE,		// MEMRAM byte at physical address vaddr set to value
+};
+
+/* Operation flags */
+#define MTRACE_FAULT 0x1	// The page was brought in from swap
+#define MTRACE_FAILED 0x2	// The operation returned an error
+
+struct memtrace_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t rec_size;	// sizeof(struct memtrace_rec)
+	uint32_t ram_size;	// MEMRAM bytes
+	uint64_t nr_recs;	// Set when the trace is closed
+	uint32_t page_size;
+	uint32_t pad;
+};
+
+struct memtrace_rec {
+	uint32_t slot;
+	uint8_t op;
+	uint8_t flags;
+	uint16_t region;
+	uint32_t pid;
+	uint32_t vaddr;
+	uint32_t pgn;
+	uint32_t fpn;		// Frame of pgn after the operation, 0 if none
+	uint32_t value;
+	uint32_t arg;
+};
+
+/* The MEMRAM being traced, NULL while tracing is off */
+extern struct memphy_struct *memtrace_ram;
+
+/* Start tracing the operations on [ram] to [path]. Return 0 on success */
+int memtrace_init(const char *path, struct memphy_struct *ram);
+
+/* Write the header, trim the file and close it */
+void memtrace_finish(void);
+
+/* Record an operation of [proc] on [vaddr] of [region], after the fact
+ * except for MTRACE_FREE */
+void memtrace_op(int op, struct pcb_t *proc, int region, uint32_t vaddr,
+		 uint32_t value, uint32_t arg, int flags);
+
+/* Record the current page table entry [pgn] of [proc] */
+void memtrace_pte(struct pcb_t *proc, int pgn);
+
+/* Record the current end of vma 0 of [proc] */
+void memtrace_brk(struct pcb_t *proc);
+
+void memtrace_put_byte(int addr, BYTE value);
+
+/* Record a write of [value] over [old] at [addr] of [mp] */
+static inline void memtrace_byte(struct memphy_struct *mp, int addr,
+				 BYTE old, BYTE value)
+{
+	if (mp == memtrace_ram && old != value)
+		memtrace_put_byte(addr, value);
+}
+
+#endif
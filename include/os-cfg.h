@@ -3,6 +3,11 @@
 
 #define MLQ_SCHED 1
 #define MAX_PRIO 140
+#define SCHED_MIGRATION_DELAY 0 // Idle slots before a CPU steals work
+#define MLFQ_LEVELS 4		// Level L runs for time_slot << L slots
+#define MLFQ_BOOST_PERIOD 64	// Slots between two MLFQ priority boosts
+#define SWAP_LOW_WATERMARK 10	// % of MEMRAM free below which processes are swapped out
+#define SWAP_HIGH_WATERMARK 25	// % of MEMRAM free above which they come back
 
 // #define MM_PAGING
 #define MM_FIXED_MEMSZ
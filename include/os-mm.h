@@ -81,6 +81,9 @@ struct memphy_struct {
    /* Management structure */
    struct framephy_struct *free_fp_list;
    struct framephy_struct *used_fp_list;
+
+   /* Number of frames on free_fp_list, read without lock by the swapper */
+   int free_fp_cnt;
 };
 
 #endif
@@ -4,18 +4,76 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 10
+#define QUEUE_INIT_SIZE 8
 
+/* Growable ring buffer of processes, a zero-filled queue_t is empty */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
-	int size;
+	struct pcb_t ** proc;
+	int head;	// Index of the first process in [proc]
+	int size;	// Number of queued processes
+	int capacity;	// Number of entries allocated in [proc]
 };
 
+void init_queue(struct queue_t * q);
+
+void free_queue(struct queue_t * q);
+
 void enqueue(struct queue_t * q, struct pcb_t * proc);
 
 struct pcb_t * dequeue(struct queue_t * q);
 
+/* Remove a specific process from the queue */
+struct pcb_t * dequeue_proc(struct queue_t * q, struct pcb_t * proc);
+
 int empty(struct queue_t * q);
 
+/*
+ * Binary min-heap of processes, [before] orders two processes.
+ * A heap_t must be initialized with init_heap().
+ */
+struct heap_t {
+	struct pcb_t ** proc;
+	int size;
+	int capacity;
+	int (*before)(struct pcb_t * a, struct pcb_t * b);
+};
+
+void init_heap(struct heap_t * h, int (*before)(struct pcb_t *, struct pcb_t *));
+
+void free_heap(struct heap_t * h);
+
+void heap_push(struct heap_t * h, struct pcb_t * proc);
+
+/* Remove and return the first process, NULL if the heap is empty */
+struct pcb_t * heap_pop(struct heap_t * h);
+
+/* Remove and return the process at index [i] of h->proc */
+struct pcb_t * heap_remove(struct heap_t * h, int i);
+
+/* Return the first process without removing it */
+struct pcb_t * heap_top(struct heap_t * h);
+
+/*
+ * Bounded lock-free single-producer/multi-consumer queue.
+ * One thread pushes, any number of threads pop concurrently.
+ * [capacity] must be a power of two.
+ */
+struct spmc_queue_t {
+	struct pcb_t ** proc;
+	unsigned long mask;
+	unsigned long head;	// Next slot to pop, advanced by consumers (CAS)
+	unsigned long tail;	// Next slot to push, advanced by the producer
+};
+
+void init_spmc_queue(struct spmc_queue_t * q, unsigned long capacity);
+
+void free_spmc_queue(struct spmc_queue_t * q);
+
+/* Return 0 on success, -1 if the queue is full */
+int spmc_push(struct spmc_queue_t * q, struct pcb_t * proc);
+
+/* Return NULL if the queue is empty */
+struct pcb_t * spmc_pop(struct spmc_queue_t * q);
+
 #endif
 
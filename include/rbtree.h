@@ -0,0 +1,47 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+
+/*
+ * Intrusive red-black tree
+ * The node is embedded in the owner struct, use rb_entry() to get back
+ * the owner. The caller does the search and links the new node with
+ * rb_link_node() before rebalancing with rb_insert_color().
+ */
+
+#define RB_RED		0
+#define RB_BLACK	1
+
+struct rb_node {
+	struct rb_node *rb_parent;
+	struct rb_node *rb_left;
+	struct rb_node *rb_right;
+	int rb_color;
+};
+
+struct rb_root {
+	struct rb_node *rb_node;
+};
+
+#define RB_ROOT (struct rb_root) { NULL, }
+
+#define rb_entry(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+				struct rb_node **rb_link)
+{
+	node->rb_parent = parent;
+	node->rb_left = node->rb_right = NULL;
+	node->rb_color = RB_RED;
+	*rb_link = node;
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+void rb_erase(struct rb_node *node, struct rb_root *root);
+
+struct rb_node *rb_first(const struct rb_root *root);
+struct rb_node *rb_next(const struct rb_node *node);
+
+#endif
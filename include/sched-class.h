@@ -0,0 +1,251 @@
+#ifndef SCHED_CLASS_H
+#define SCHED_CLASS_H
+
+/*
+ * Scheduler internals shared by the core (sched.c) and the policies
+ * (scheduling classes). Not meant to be included outside of the scheduler.
+ */
+
+#include "common.h"
+#include "queue.h"
+#include "bitops.h"
+#include "rbtree.h"
+#include "sched.h"
+#include <limits.h>
+#include <pthread.h>
+
+/* MLQ policy state of one run queue */
+struct mlq_rq {
+	struct queue_t ready_queue[MAX_PRIO];
+	int slot[MAX_PRIO];
+
+	/*
+	 *  Priority bitmaps of the MLQ levels
+	 *  ready_map   : level prio has at least one queued process
+	 *  expired_map : level prio has spent its slot budget in the current epoch
+	 *  A level is eligible for dispatch iff it is ready and not expired.
+	 */
+	unsigned long ready_map[BITS_TO_LONGS(MAX_PRIO)];
+	unsigned long expired_map[BITS_TO_LONGS(MAX_PRIO)];
+
+	/* Budget epoch, slot[prio] is only valid when slot_epoch[prio] == epoch */
+	unsigned long epoch;
+	unsigned long slot_epoch[MAX_PRIO];
+
+	/* Last slot the aging pass ran */
+	uint64_t last_aging;
+
+	/* Dispatch statistics: bitmap words examined and epochs started */
+	unsigned long dispatch_cost;
+	unsigned long epoch_cnt;
+	unsigned long aging_cnt;
+};
+
+/* MLFQ policy state of one run queue */
+struct mlfq_rq {
+	struct queue_t level[MLFQ_LEVELS];
+	uint64_t last_boost;	// Last slot every level was moved to the top
+
+	/* Statistics */
+	unsigned long demote_cnt;
+	unsigned long boost_cnt;
+	unsigned long dispatch_cnt[MLFQ_LEVELS];
+};
+
+/* CFS policy state of one run queue */
+struct cfs_rq {
+	struct rb_root tasks_timeline;	// Runnable processes keyed by vruntime
+	struct rb_node *leftmost;	// Cached smallest vruntime
+	uint64_t min_vruntime;		// Monotonic floor of the queued vruntimes
+};
+
+/* Stride policy state of one run queue */
+struct stride_rq {
+	struct heap_t heap;	// Runnable processes, smallest pass first
+	uint64_t global_pass;	// Monotonic floor of the queued passes
+};
+
+/* EDF class state of one run queue */
+struct edf_rq {
+	struct heap_t heap;	// Deadline processes, earliest deadline first
+};
+
+/*
+ *  Per-CPU run queue
+ *  Every simulated CPU owns one run queue with its own lock, so dispatching
+ *  on one CPU does not serialize with the others. A CPU only touches a peer
+ *  run queue when it is idle and steals work from it.
+ */
+struct sched_rq {
+	pthread_mutex_t lock;
+	int cpu;
+	int speed;	// Instructions executed per slot
+
+	struct edf_rq edf;
+	struct mlq_rq mlq;
+	struct mlfq_rq mlfq;
+	struct cfs_rq cfs;
+	struct stride_rq stride;
+
+	/* Process currently running on this CPU (at most one) */
+	struct queue_t running_list;
+
+	/* Hints read without the lock by other CPUs: whether the CPU found
+	 * nothing to run, and the deadline of what it runs (EDF_NO_DEADLINE
+	 * for a process without one) */
+	int idle;
+	uint64_t curr_deadline;
+
+	/* Preemption rank of what the CPU runs, see sched_class.preempt_key.
+	 * -1 when it cannot be preempted by an arrival */
+	int curr_key;
+
+	/* Slot the CPU last went idle, valid while idle is set */
+	uint64_t idle_since;
+
+	/* Timer event of the CPU while it is parked, NULL otherwise.
+	 * Protected by the park lock, not by rq->lock */
+	struct timer_id_t *parked;
+
+	/* Set by another CPU to have this one reschedule at the next slot */
+	int need_resched;
+
+	/* Number of queued processes, read without the lock by thieves */
+	int nr_running;
+
+	/* Queued processes by loaded priority, read without the lock by
+	 * thieves to find the run queue holding the most urgent work */
+	int nr_prio[MAX_PRIO];
+
+	/* Dispatch statistics */
+	unsigned long dispatch_cnt;
+	unsigned long steal_cnt;
+	unsigned long park_cnt;
+	unsigned long preempt_cnt;	// Arrivals that preempted this CPU
+	uint64_t busy_slots;		// Slots spent running a process
+	uint64_t parked_slots;
+
+	/* Dispatches and longest wait in the ready queue, by loaded priority */
+	unsigned long wait_cnt[MAX_PRIO];
+	uint64_t max_wait[MAX_PRIO];
+};
+
+/*
+ *  Scheduling class, one per policy
+ *  All hooks but init_rq/free_rq/report are called with rq->lock held.
+ */
+struct sched_class {
+	const char *name;
+
+	void (*init_rq)(struct sched_rq *rq);
+	void (*free_rq)(struct sched_rq *rq);
+
+	/* Queue [proc] on [rq], [new] is set when the process was just loaded */
+	void (*enqueue)(struct sched_rq *rq, struct pcb_t *proc, int new);
+
+	/* Remove and return the next process to run, NULL if none is queued */
+	struct pcb_t *(*pick_next)(struct sched_rq *rq);
+
+	/* Remove and return the next process allowed to run on [cpu], for a
+	 * CPU stealing from [rq]. NULL if none is queued */
+	struct pcb_t *(*steal)(struct sched_rq *rq, int cpu);
+
+	/* Charge [ran] slots to [proc] before it is queued again */
+	void (*put_prev)(struct sched_rq *rq, struct pcb_t *proc, int ran);
+
+	/* [proc] was taken from [src] and will run on [dst] (optional) */
+	void (*migrate)(struct sched_rq *src, struct sched_rq *dst,
+			struct pcb_t *proc);
+
+	/* Slots [proc] may run on its next dispatch (optional, the time slot
+	 * or the adaptive quantum otherwise). Called without any lock */
+	int (*quantum)(struct pcb_t *proc, int time_slot);
+
+	/* Rank of [proc] for arrival preemption, lower ranks run first. A new
+	 * process preempts the CPU running the highest rank if it is lower
+	 * (optional, arrivals never preempt without it) */
+	int (*preempt_key)(struct pcb_t *proc);
+
+	/* Print the policy statistics of all run queues (optional) */
+	void (*report)(struct sched_rq *rqs, int nr);
+};
+
+#define EDF_NO_DEADLINE UINT64_MAX
+
+/*
+ *  CPU bandwidth group
+ *  The processes of a group may run quota slots in total, over all CPUs,
+ *  in every period. Once the quota is spent they are throttled: taken out
+ *  of the run queues into throttled_list until the next period starts.
+ *  Usage is charged at the end of each slot, so the quota may be overrun
+ *  by one slot on every CPU that was running the group at that time.
+ */
+#define SCHED_MAX_GROUPS 16
+
+struct sched_group {
+	char name[32];
+	int quota;
+	int period;
+
+	pthread_mutex_t lock;
+	uint64_t period_start;		// First slot of the current period
+	int usage;			// Slots used in the current period
+	int throttled;			// Quota spent, read without the lock
+	struct queue_t throttled_list;
+
+	/* Statistics */
+	unsigned long total_usage;
+	unsigned long throttle_cnt;	// Periods the quota ran out
+	unsigned long throttled_procs;	// Processes taken off a run queue
+};
+
+/* Accounting kept for a process once it has finished */
+struct proc_stat {
+	uint32_t pid;
+	uint32_t prio;
+	uint64_t arrival;
+	uint64_t first_run;
+	uint64_t deadline;
+	uint64_t finish;
+	unsigned long migrations;
+	unsigned long switches;
+	int tickets;
+	uint64_t runtime;
+	uint64_t wait;
+	int quantum;
+};
+
+/* Finished processes in order of completion, see finish_proc() */
+extern struct proc_stat *proc_stats;
+extern int nr_proc_stats;
+
+/* Tunables set from the command line before init_scheduler() */
+extern int sched_aging_slots;
+extern int sched_migration_delay;
+extern int sched_quantum_min, sched_quantum_max;
+extern int sched_mlfq_boost;
+extern int sched_arrival_preempt;
+
+/* CPUs an affinity mask can name, BITS_PER_LONG only covers the bitmaps */
+#define AFFINITY_BITS ((int)(sizeof(unsigned long) * CHAR_BIT))
+
+/* Whether the affinity mask of [proc] lets it run on [cpu] */
+static inline int proc_allowed(struct pcb_t *proc, int cpu)
+{
+	return proc->affinity == 0 ||
+	       (cpu < AFFINITY_BITS && (proc->affinity & (1UL << cpu)));
+}
+
+/* Instructions [proc] has left to run, stable while it is queued */
+static inline uint32_t proc_remaining(struct pcb_t *proc)
+{
+	return proc->code->size - proc->pc;
+}
+
+extern const struct sched_class edf_sched_class;
+extern const struct sched_class mlq_sched_class;
+extern const struct sched_class mlfq_sched_class;
+extern const struct sched_class cfs_sched_class;
+extern const struct sched_class stride_sched_class;
+
+#endif
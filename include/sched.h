@@ -1,28 +1,117 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
+struct timer_id_t;
+
 #ifndef MLQ_SCHED
 #define MLQ_SCHED
 #endif
 
 #define MAX_PRIO 140
 
+/* Whether no process waits to run, 1 if none */
 int queue_empty(void);
 
-void init_scheduler(void);
+/* Select the scheduling policy by name ("mlq", "mlfq", "cfs", "stride"), before
+ * init_scheduler(). Return 0 on success, -1 if the name is unknown */
+int sched_set_policy(const char * name);
+
+/* Raise the priority of a process by one level every [slots] time slots
+ * it waits in the MLQ ready queue, 0 disables aging */
+void sched_set_aging(int slots);
+
+/* Keep processes on their CPU: an idle CPU only steals from a peer once
+ * it has been idle for [slots] time slots */
+void sched_set_migration_delay(int slots);
+
+/* Adaptive time quantum: a process that used its whole quantum gets twice
+ * as long on its next dispatch, one put back earlier gets half, within
+ * [min, max]. max = 0 gives every process the time slot of the config */
+void sched_set_quantum(int min, int max);
+
+/* MLFQ: move every process back to the top level every [slots] time
+ * slots, 0 disables the boost */
+void sched_set_boost(int slots);
+
+/* Let a newly loaded process preempt the CPU running the lowest priority
+ * process at the next slot boundary */
+void sched_set_preempt(int on);
+
+/* Number of slots [proc] may run on its next dispatch */
+int sched_quantum(struct pcb_t * proc, int time_slot);
+
+void init_scheduler(int num_cpus);
+
+/* CPU [cpu] executes [speed] instructions per slot, after init_scheduler().
+ * New and stolen work goes to the fastest idle CPU first */
+void sched_set_cpu_speed(int cpu, int speed);
 void finish_scheduler(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Write the accounting of every finished process to [path] as CSV, before
+ * finish_scheduler(). Return 0 on success */
+int sched_write_metrics(const char * path);
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Declare a bandwidth group, its processes may run [quota] slots in total
+ * over all CPUs in every [period] slots. Return the group id (> 0), or -1
+ * if there are too many groups */
+int sched_add_group(const char * name, int quota, int period);
+
+/* Id of the group named [name], 0 if there is none */
+int sched_find_group(const char * name);
+
+#ifdef MM_PAGING
+/* Swap whole processes out of [mram] when its free frames fall below
+ * SWAP_LOW_WATERMARK percent, and back in above SWAP_HIGH_WATERMARK */
+void sched_set_swap(struct memphy_struct * mram);
+
+/* Whether MEMRAM is short of frames, the loader holds new processes back */
+int sched_mem_pressure(void);
+#endif
+
+/* Charge the slot [proc] just ran on CPU [cpu] */
+void sched_tick(int cpu, struct pcb_t * proc);
+
+/* Get the next process to run on CPU [cpu] */
+struct pcb_t * get_proc(int cpu);
+
+/* Put a process that was running on CPU [cpu] back to its run queue */
+void put_proc(int cpu, struct pcb_t * proc);
 
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
 
+/*
+ * Sleep through the coming slots on CPU [cpu] until add_proc() or
+ * put_proc() has work for it. Falls back to next_slot() when work is
+ * already queued or once sched_unpark_all() was called.
+ */
+void sched_park(int cpu, struct timer_id_t * timer_id);
+
+/* Wake every parked CPU and stop parking, the loader is done */
+void sched_unpark_all(void);
+
+/* The process running on CPU [cpu] has finished, called before it is freed */
+void finish_proc(int cpu, struct pcb_t * proc);
+
+/* Return non-zero if CPU [cpu] should preempt its process at this slot */
+int need_resched(int cpu);
+
+/* Whether CPU [cpu], with nothing to run, should stay up anyway: a slower
+ * CPU is running a process that put_proc() may hand over to it */
+int sched_keep_cpu(int cpu);
+
+/* Follow the schedule of the trace at [path], written with -t for the same
+ * configuration, instead of the policy: CPUs dispatch, put back and finish
+ * the processes the trace says, when it says. After init_scheduler().
+ * Return 0 on success, -1 if [path] is not a trace of as many CPUs */
+int sched_replay(const char * path);
+
+/* While replaying, whether the trace admits the next process now: 1 if
+ * it does, 0 if later, -1 if it admits no more processes */
+int sched_replay_admit(void);
+
 #endif
 
 
@@ -5,12 +5,10 @@
 #include <stdint.h>
 
 struct timer_id_t {
-	int done;
 	int fsh;
-	pthread_cond_t event_cond;
-	pthread_mutex_t event_lock;
-	pthread_cond_t timer_cond;
-	pthread_mutex_t timer_lock;
+	uint32_t parked;	// Sleeping through slots until unpark_event()
+	uint32_t resume_gen;	// Slot generation it is counted in again
+	pthread_cond_t park_cond;
 };
 
 void start_timer();
@@ -21,8 +19,38 @@ struct timer_id_t * attach_event();
 
 void detach_event(struct timer_id_t * event);
 
+/* Wait until every attached device is done with the current slot */
 void next_slot(struct timer_id_t* timer_id);
 
+/* Keep the device done for every following slot, without waking it up,
+ * until unpark_event(); it then resumes at the next slot. The device
+ * calls next_slot() right after parking */
+void park_event(struct timer_id_t* timer_id);
+
+void unpark_event(struct timer_id_t* timer_id);
+
+/* Jump to slot [until] at once when [timer_id] is the only device taking
+ * part in slots, printing the slots in between as next_slot() would.
+ * Return 0 and leave the time alone otherwise */
+int skip_slots(struct timer_id_t* timer_id, uint64_t until);
+
+/* Move the time to slot [until], printing every slot on the way. Only
+ * for a caller that runs without attached devices */
+void step_slots(uint64_t until);
+
+/* Time of the calling device, see set_sync_quantum() */
 uint64_t current_time();
 
+/* Time of the last barrier, no device clock is behind it. Stamp with it
+ * the events other devices compare their own time against */
+uint64_t sync_time();
+
+/* Go through the barrier every [slots] slots only, devices run on their
+ * own clock in between. Must be called before the devices start */
+void set_sync_quantum(int slots);
+
+/* Leave the wall time out of the stop_timer() report, so that the output
+ * of a deterministic run is the same every time */
+void set_timer_wall_clock(int on);
+
 #endif
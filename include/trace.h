@@ -0,0 +1,99 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ *  Scheduler event trace
+ *  Every CPU appends to its own single-producer ring, and a writer thread
+ *  drains the rings to the file. Neither side takes a lock. An event
+ *  costs a few plain stores and a release store of head. The CPU reloads
+ *  the writer's tail only when its cached copy says the ring is full,
+ *  and it waits for the writer rather than drop the event. The loader has the
+ *  ring after the last CPU, its events carry cpu = nr_cpus.
+ *
+ *  File layout: one struct trace_header, then struct trace_event records.
+ *  The records of one CPU are in time order, records of different CPUs
+ *  are interleaved in chunks of up to TRACE_RING_EVENTS.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC "SCHT"
+#define TRACE_VERSION 2
+#define TRACE_RING_EVENTS 4096	// Per ring, a power of two
+
+enum trace_type {
+	TRACE_DISPATCH = 1,	// pid starts running, arg: its priority
+	TRACE_PREEMPT,		// pid put back, arg: slots it ran
+	TRACE_FINISH,		// pid finished, arg: slots it ran
+	TRACE_IDLE,		// the CPU found nothing to run
+	TRACE_STEAL,		// pid taken from a peer, arg: that CPU
+	TRACE_SWAP_OUT,		// pid suspended to swap, arg: pages written
+	TRACE_SWAP_IN,		// pid brought back from swap
+	TRACE_ADMIT,		// pid handed to the scheduler by the loader
+	TRACE_THROTTLE,		// pid parked with its group until the next period
+	TRACE_KICK,		// pid preempts CPU arg on arrival, from the loader
+};
+
+struct trace_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t nr_cpus;
+	uint32_t event_size;	// sizeof(struct trace_event)
+};
+
+struct trace_event {
+	uint32_t time;
+	uint16_t cpu;
+	uint8_t type;
+	uint8_t pad;
+	uint32_t pid;
+	uint32_t arg;
+};
+
+/* Positions count events from the start and wrap around as uint32_t */
+struct trace_ring {
+	/* Producer side, written by the CPU only */
+	struct trace_event *ev;
+	uint32_t head;		// Next event to write, published with release
+	uint32_t tail_cache;	// Last tail seen by the CPU
+
+	/* Consumer side, written by the writer only */
+	uint32_t tail __attribute__((aligned(64)));	// Next event to write out
+} __attribute__((aligned(64)));
+
+/* NULL while tracing is off */
+extern struct trace_ring *trace_rings;
+
+/* Start tracing [nr_cpus] CPUs to [path]. Return 0 on success */
+int trace_init(const char *path, int nr_cpus);
+
+/* Wait until the writer has made room in the full ring [r] */
+void trace_wait(struct trace_ring *r);
+
+/* Write out what is left and close the file, once every CPU is done */
+void trace_finish(void);
+
+/* Record an event of CPU [cpu], called by that CPU only, or by the
+ * loader with [cpu] = nr_cpus */
+static inline void trace_event(int cpu, int type, uint32_t time,
+			       uint32_t pid, uint32_t arg)
+{
+	struct trace_ring *r;
+	struct trace_event *e;
+
+	if (trace_rings == NULL)
+		return;
+	r = &trace_rings[cpu];
+	if (r->head - r->tail_cache == TRACE_RING_EVENTS)
+		trace_wait(r);
+	e = &r->ev[r->head & (TRACE_RING_EVENTS - 1)];
+	e->time = time;
+	e->cpu = cpu;
+	e->type = type;
+	e->pid = pid;
+	e->arg = arg;
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
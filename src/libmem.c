@@ -18,6 +18,8 @@
 #include "mm.h"
 #include "syscall.h"
 #include "libmem.h"
+#include "log.h"
+#include "memtrace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -160,23 +162,27 @@ int pte_is_valid(uint32_t pte) {
       uint32_t pte = pgd[i];
       if (pte_is_valid(pte)) {
           int frame_number = PAGING_FPN(pte);
-          printf("Page Number: %d -> Frame Number: %d\n", i, frame_number);
+          log_printf(LOG_DUMP, "Page Number: %d -> Frame Number: %d\n", i, frame_number);
       }
   }
 }
 int liballoc(struct pcb_t *proc, uint32_t size, uint32_t reg_index)
 {
-  int addr;
+  int addr = 0;
   int result = __alloc(proc, 0, reg_index, size, &addr);
   /* By default using vmaid = 0 */
+  memtrace_op(MTRACE_ALLOC, proc, reg_index, addr, size, 0,
+              result ? MTRACE_FAILED : 0);
   #ifdef IODUMP
-  printf("===== PHYSICAL MEMORY AFTER ALLOCATION =====\n");
-  printf("PID=%d - Region=%d - Address=%08X - Size=%d byte\n", proc->pid , reg_index, addr, size);
+  if (memtrace_ram == NULL) {
+  log_printf(LOG_DUMP, "===== PHYSICAL MEMORY AFTER ALLOCATION =====\n");
+  log_printf(LOG_DUMP, "PID=%d - Region=%d - Address=%08X - Size=%d byte\n", proc->pid , reg_index, addr, size);
   #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); //print max TBL
   #endif
   print_page_frame_mapping(proc->mm->pgd);
-  printf("================================================================\n");
+  log_printf(LOG_DUMP, "================================================================\n");
+  }
   #endif
 
   return result;
@@ -192,16 +198,25 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
 {
   /* By default using vmaid = 0 */
   #ifdef IODUMP
-  printf("===== PHYSICAL MEMORY AFTER DEALLOCATION =====\n");
-  printf("PID=%d - Region=%d\n", proc->pid , reg_index);
+  if (memtrace_ram == NULL) {
+  log_printf(LOG_DUMP, "===== PHYSICAL MEMORY AFTER DEALLOCATION =====\n");
+  log_printf(LOG_DUMP, "PID=%d - Region=%d\n", proc->pid , reg_index);
   #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); //print max TBL
   #endif
   print_page_frame_mapping(proc->mm->pgd);
-  printf("================================================================\n");
+  log_printf(LOG_DUMP, "================================================================\n");
+  }
   #endif
 
-  return __free(proc, 0, reg_index);
+  /* Freeing leaves the page table alone, so the record can follow it */
+  struct vm_rg_struct *rg = get_symrg_byid(proc->mm, reg_index);
+  uint32_t start = rg ? rg->rg_start : 0;
+  int result = __free(proc, 0, reg_index);
+
+  memtrace_op(MTRACE_FREE, proc, reg_index, start, 0, 0,
+              result ? MTRACE_FAILED : 0);
+  return result;
 }
 
 /*pg_getpage - get the page in ram
@@ -252,15 +267,13 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller) {
       __sys_memmap(caller, &regs);
 
       //Tạo và thêm lại framephy_struct swpfpn vào free_list
-      struct framephy_struct *swpframe = (struct framephy_struct *)malloc(sizeof(struct framephy_struct));
-      swpframe->fpn = swpfpn;
-      swpframe->owner = NULL;
-      swpframe->fp_next = caller->active_mswp->free_fp_list;
-      caller->active_mswp->free_fp_list = swpframe;
+      MEMPHY_put_freefp(caller->active_mswp, swpfpn);
 
       // Cập nhật lại page table
       pte_set_swap(&mm->pgd[vicpgn], caller->active_mswp_id ,tgtfpn); // Đánh dấu victim đã bị swapped
       pte_set_fpn(&mm->pgd[pgn], vicfpn);     // Đánh dấu trang mới đã được load vào RAM
+      memtrace_pte(caller, vicpgn);
+      memtrace_pte(caller, pgn);
 
       // Thêm trang vào FIFO
       enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
@@ -362,6 +375,38 @@ int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data)
   return 0;
 }
 
+/*access_faults - whether an access to a region has to bring its page
+ *                in, checked for the memory trace only
+ *@proc: Process executing the instruction
+ *@rgid: memory region ID
+ *@offset: offset in the region
+ */
+static int access_faults(struct pcb_t *proc, uint32_t rgid, uint32_t offset)
+{
+  struct vm_rg_struct *rg;
+  uint32_t vaddr;
+
+  if (memtrace_ram == NULL || (rg = get_symrg_byid(proc->mm, rgid)) == NULL)
+    return 0;
+  vaddr = rg->rg_start + offset;
+  if (PAGING_PAGE_PRESENT(proc->mm->pgd[PAGING_PGN(vaddr)]))
+    return 0;
+  return MTRACE_FAULT;
+}
+
+/*trace_access - record a read or write in the memory trace */
+static void trace_access(int op, struct pcb_t *proc, uint32_t rgid,
+                         uint32_t offset, BYTE data, int flags)
+{
+  struct vm_rg_struct *rg;
+
+  if (memtrace_ram == NULL)
+    return;
+  rg = get_symrg_byid(proc->mm, rgid);
+  memtrace_op(op, proc, rgid, rg ? rg->rg_start + offset : 0, data, offset,
+              flags);
+}
+
 /*libread - PAGING-based read a region memory */
 int libread(
     struct pcb_t *proc, // Process executing the instruction
@@ -370,9 +415,12 @@ int libread(
     uint32_t* destination)
 {
 
-  BYTE data;
+  BYTE data = 0;
+  int fault = access_faults(proc, source, offset);
   int val = __read(proc, 0, source, offset, &data);
 
+  trace_access(MTRACE_READ, proc, source, offset, data,
+               fault | (val ? MTRACE_FAILED : 0));
   if (val != 0) {
     // Nếu có lỗi khi đọc, trả về giá trị lỗi
     return val;
@@ -380,14 +428,16 @@ int libread(
   // Nếu không có lỗi, cập nhật kết quả vào destination
   *destination = (uint32_t)data;
 #ifdef IODUMP
-  printf("===== PHYSICAL MEMORY AFTER READING =====\n");
-  printf("read region=%d offset=%d value=%d\n", source, offset, data);
+  if (memtrace_ram == NULL) {
+  log_printf(LOG_DUMP, "===== PHYSICAL MEMORY AFTER READING =====\n");
+  log_printf(LOG_DUMP, "read region=%d offset=%d value=%d\n", source, offset, data);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); //print max TBL
 #endif
   print_page_frame_mapping(proc->mm->pgd);
-  printf("================================================================\n");
+  log_printf(LOG_DUMP, "================================================================\n");
   MEMPHY_dump(proc->mram);
+  }
 #endif
   return val;
 }
@@ -420,16 +470,22 @@ int libwrite(
     uint32_t destination, // Index of destination register
     uint32_t offset)
 {
+  int fault = access_faults(proc, destination, offset);
   int val = __write(proc, 0, destination, offset, data);
+
+  trace_access(MTRACE_WRITE, proc, destination, offset, data,
+               fault | (val ? MTRACE_FAILED : 0));
 #ifdef IODUMP
-  printf("===== PHYSICAL MEMORY AFTER WRITING =====\n");
-  printf("write region=%d offset=%d value=%d\n", destination, offset, data);
+  if (memtrace_ram == NULL) {
+  log_printf(LOG_DUMP, "===== PHYSICAL MEMORY AFTER WRITING =====\n");
+  log_printf(LOG_DUMP, "write region=%d offset=%d value=%d\n", destination, offset, data);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); //print max TBL
 #endif
   print_page_frame_mapping(proc->mm->pgd);
-  printf("================================================================\n");
+  log_printf(LOG_DUMP, "================================================================\n");
   MEMPHY_dump(proc->mram);
+  }
 #endif
 
   return val;
@@ -445,12 +501,15 @@ int free_pcb_memph(struct pcb_t *caller)
   int pagenum, fpn;
   uint32_t pte;
 
-
+  pthread_mutex_lock(&mmvm_lock);
   for(pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
   {
     pte= caller->mm->pgd[pagenum];
 
     if (!PAGING_PAGE_PRESENT(pte))
+      continue;
+
+    if (!(pte & PAGING_PTE_SWAPPED_MASK))
     {
       fpn = PAGING_PTE_FPN(pte);
       MEMPHY_put_freefp(caller->mram, fpn);
@@ -458,11 +517,87 @@ int free_pcb_memph(struct pcb_t *caller)
       fpn = PAGING_PTE_SWP(pte);
       MEMPHY_put_freefp(caller->active_mswp, fpn);    
     }
+    caller->mm->pgd[pagenum] = 0;
+    memtrace_pte(caller, pagenum);
   }
+  pthread_mutex_unlock(&mmvm_lock);
 
   return 0;
 }
 
+/*swap_out_pcb - write every resident page of a suspended process to
+ *               its active swap and release the frames
+ *@caller: caller, must not be running
+ *
+ * Return the number of pages written out
+ */
+int swap_out_pcb(struct pcb_t *caller)
+{
+  struct pgn_t *pg;
+  uint32_t *pte;
+  int fpn, swpfpn, nr = 0;
+
+  pthread_mutex_lock(&mmvm_lock);
+  for (pg = caller->mm->fifo_pgn; pg != NULL; pg = pg->pg_next)
+  {
+    pte = &caller->mm->pgd[pg->pgn];
+    if (!PAGING_PAGE_PRESENT(*pte) || (*pte & PAGING_PTE_SWAPPED_MASK))
+      continue;
+    if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) != 0)
+      break; /* Swap is full, keep the rest resident */
+
+    fpn = PAGING_PTE_FPN(*pte);
+    __swap_cp_page(caller->mram, fpn, caller->active_mswp, swpfpn);
+    pte_set_swap(pte, caller->active_mswp_id, swpfpn);
+    memtrace_pte(caller, pg->pgn);
+    MEMPHY_put_freefp(caller->mram, fpn);
+    nr++;
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return nr;
+}
+
+/*swap_in_pcb - bring back the pages written out by swap_out_pcb
+ *@caller: caller, must not be running
+ *
+ * Nothing is moved unless MEMRAM has a frame for every page.
+ * Return the number of pages read back, -1 if MEMRAM is short of frames
+ */
+int swap_in_pcb(struct pcb_t *caller)
+{
+  struct pgn_t *pg;
+  uint32_t *pte;
+  int fpn, swpfpn, nr = 0;
+
+  pthread_mutex_lock(&mmvm_lock);
+  for (pg = caller->mm->fifo_pgn; pg != NULL; pg = pg->pg_next)
+    if (caller->mm->pgd[pg->pgn] & PAGING_PTE_SWAPPED_MASK)
+      nr++;
+  if (nr > MEMPHY_nr_freefp(caller->mram))
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1;
+  }
+
+  for (pg = caller->mm->fifo_pgn; pg != NULL; pg = pg->pg_next)
+  {
+    pte = &caller->mm->pgd[pg->pgn];
+    if (!(*pte & PAGING_PTE_SWAPPED_MASK))
+      continue;
+
+    MEMPHY_get_freefp(caller->mram, &fpn);
+    swpfpn = PAGING_PTE_SWP(*pte);
+    __swap_cp_page(caller->active_mswp, swpfpn, caller->mram, fpn);
+    pte_set_fpn(pte, fpn);
+    memtrace_pte(caller, pg->pgn);
+    MEMPHY_put_freefp(caller->active_mswp, swpfpn);
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return nr;
+}
+
 
 /*find_victim_page - find victim page
  *@caller: caller
@@ -34,7 +34,7 @@ static enum ins_opcode_t get_opcode(char * opt) {
 
 struct pcb_t * load(const char * path) {
 	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
+	struct pcb_t * proc = (struct pcb_t * )calloc(1, sizeof(struct pcb_t));
 	proc->pid = avail_pid;
 	avail_pid++;
 	proc->page_table =
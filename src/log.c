@@ -0,0 +1,535 @@
+/*
+ * Buffered simulator output, see log.h
+ */
+
+#include "log.h"
+#include "timer.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_CHUNK_SIZE 65536
+#define LOG_ARGS_MAX 256	// Larger arguments are packed on the heap
+#define LOG_SPEC_MAX 32		// Longest conversion specification
+#define LOG_DRAIN_NS 1000000	// Writer period
+#define LOG_ID_ANY UINT32_MAX	// Threads that did not call log_thread()
+
+#define LOG_ALIGN(n) (((n) + 7) & ~7u)
+
+struct log_rec
+{
+	uint64_t slot;
+	uint32_t id;		// 0 for time lines, else the thread id
+	uint32_t len;		// Bytes of the message following the header
+};
+
+/*
+ *  A message is not formatted by the thread that logs it. The record holds
+ *  the format pointer, then its arguments, each aligned to 8 bytes, and
+ *  the writer formats it. A string argument is copied as its length and
+ *  its bytes, as the caller may reuse it. Formats must be string literals,
+ *  %n is not supported.
+ */
+enum log_arg
+{
+	LOG_ARG_NONE,		// %% or unsupported
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_LLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_INTMAX,
+	LOG_ARG_PTRDIFF,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_LDOUBLE,
+	LOG_ARG_PTR,
+	LOG_ARG_STR,
+};
+
+/*
+ *  A thread appends records to the last chunk of its buffer and publishes
+ *  them by moving used forward, the writer consumes them from the first
+ *  chunk. Once next is set the thread never touches the chunk again and
+ *  the writer frees it when it has read everything in it.
+ */
+struct log_chunk
+{
+	struct log_chunk *next;
+	uint32_t used;
+	uint32_t size;
+	char data[];
+};
+
+struct log_buf
+{
+	struct log_chunk *head;	// Oldest chunk, the writer's side
+	struct log_chunk *tail;	// Chunk the thread appends to
+	uint32_t read;		// Writer position in head
+	struct log_buf *next;
+};
+
+static struct log_buf *log_bufs;	// Every thread that logged
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;	// Adding to log_bufs
+static __thread struct log_buf *my_buf;
+static __thread uint32_t my_id = LOG_ID_ANY;
+
+static const char *log_names[LOG_NR_CATS] = {"time", "sched", "mem", "dump"};
+static uint32_t log_mask = (1u << LOG_NR_CATS) - 1;
+static int log_running;
+static int log_stop;
+static pthread_t log_writer;
+
+/*
+ *  log_spec - parse the conversion specification at [p], just after the %
+ *  @stars: returns the number of * int arguments before the value
+ *  @arg: returns the type of the value
+ *  Return the first character past the specification.
+ */
+static const char *log_spec(const char *p, int *stars, enum log_arg *arg)
+{
+	int l = 0, h = 0;
+
+	*stars = 0;
+	while (*p && strchr("-+ #0", *p))
+		p++;
+	if (*p == '*')
+	{
+		(*stars)++;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.')
+	{
+		p++;
+		if (*p == '*')
+		{
+			(*stars)++;
+			p++;
+		}
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	*arg = LOG_ARG_INT;
+	for (;; p++)
+	{
+		if (*p == 'h')
+			h++;
+		else if (*p == 'l')
+			l++;
+		else if (*p == 'z')
+			*arg = LOG_ARG_SIZE;
+		else if (*p == 'j')
+			*arg = LOG_ARG_INTMAX;
+		else if (*p == 't')
+			*arg = LOG_ARG_PTRDIFF;
+		else if (*p == 'L')
+			*arg = LOG_ARG_LDOUBLE;
+		else
+			break;
+	}
+	switch (*p)
+	{
+	case 'c':
+		*arg = LOG_ARG_INT;
+		break;
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		if (*arg == LOG_ARG_LDOUBLE || h)
+			*arg = LOG_ARG_INT;
+		else if (l)
+			*arg = l == 1 ? LOG_ARG_LONG : LOG_ARG_LLONG;
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		*arg = *arg == LOG_ARG_LDOUBLE ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+		break;
+	case 's':
+		*arg = LOG_ARG_STR;
+		break;
+	case 'p':
+		*arg = LOG_ARG_PTR;
+		break;
+	default:
+		*stars = 0;
+		*arg = LOG_ARG_NONE;
+	}
+	return *p ? p + 1 : p;
+}
+
+#define LOG_PUT(type, val) do {						\
+		type v_ = (val);					\
+		if (pos + sizeof(v_) <= cap)				\
+			memcpy(buf + pos, &v_, sizeof(v_));		\
+		pos += LOG_ALIGN(sizeof(v_));				\
+	} while (0)
+
+/* Pack the arguments of [fmt] into [buf], return the bytes they need,
+ * nothing past [cap] is written */
+static size_t log_pack(char *buf, size_t cap, const char *fmt, va_list ap)
+{
+	size_t pos = 0;
+	enum log_arg arg;
+	const char *str;
+	int stars;
+	uint32_t len;
+
+	while ((fmt = strchr(fmt, '%')) != NULL)
+	{
+		fmt = log_spec(fmt + 1, &stars, &arg);
+		while (stars--)
+			LOG_PUT(int, va_arg(ap, int));
+		switch (arg)
+		{
+		case LOG_ARG_NONE:
+			break;
+		case LOG_ARG_INT:
+			LOG_PUT(int, va_arg(ap, int));
+			break;
+		case LOG_ARG_LONG:
+			LOG_PUT(long, va_arg(ap, long));
+			break;
+		case LOG_ARG_LLONG:
+			LOG_PUT(long long, va_arg(ap, long long));
+			break;
+		case LOG_ARG_SIZE:
+			LOG_PUT(size_t, va_arg(ap, size_t));
+			break;
+		case LOG_ARG_INTMAX:
+			LOG_PUT(intmax_t, va_arg(ap, intmax_t));
+			break;
+		case LOG_ARG_PTRDIFF:
+			LOG_PUT(ptrdiff_t, va_arg(ap, ptrdiff_t));
+			break;
+		case LOG_ARG_DOUBLE:
+			LOG_PUT(double, va_arg(ap, double));
+			break;
+		case LOG_ARG_LDOUBLE:
+			LOG_PUT(long double, va_arg(ap, long double));
+			break;
+		case LOG_ARG_PTR:
+			LOG_PUT(void *, va_arg(ap, void *));
+			break;
+		case LOG_ARG_STR:
+			str = va_arg(ap, const char *);
+			if (str == NULL)
+				str = "(null)";
+			len = strlen(str);
+			LOG_PUT(uint32_t, len);
+			if (pos + len + 1 <= cap)
+				memcpy(buf + pos, str, len + 1);
+			pos += LOG_ALIGN(len + 1);
+			break;
+		}
+	}
+	return pos;
+}
+
+#define LOG_GET(type, var) do {						\
+		memcpy(&(var), args, sizeof(type));			\
+		args += LOG_ALIGN(sizeof(type));			\
+	} while (0)
+
+#define LOG_EMIT(type) do {						\
+		type v_;						\
+		LOG_GET(type, v_);					\
+		if (stars == 0)						\
+			printf(spec, v_);				\
+		else if (stars == 1)					\
+			printf(spec, star[0], v_);			\
+		else							\
+			printf(spec, star[0], star[1], v_);		\
+	} while (0)
+
+/* Format the message of [rec] to stdout, on the writer */
+static void log_format(struct log_rec *rec)
+{
+	const char *fmt, *p, *args = (const char *)(rec + 1);
+	char spec[LOG_SPEC_MAX];
+	enum log_arg arg;
+	int stars, star[2], i, n;
+	uint32_t len;
+
+	LOG_GET(const char *, fmt);
+	while ((p = strchr(fmt, '%')) != NULL)
+	{
+		fwrite(fmt, 1, p - fmt, stdout);
+		fmt = log_spec(p + 1, &stars, &arg);
+		for (i = 0; i < stars; i++)
+			LOG_GET(int, star[i]);
+		if (arg == LOG_ARG_NONE)
+		{
+			/* %% */
+			if (fmt[-1] == '%')
+				putchar('%');
+			continue;
+		}
+		n = fmt - p;
+		if (n >= LOG_SPEC_MAX)
+		{
+			/* Too wide, keep the type only */
+			for (n = 1; strchr("hlzjtL", fmt[-1 - n]); n++)
+				;
+			stars = 0;
+			spec[0] = '%';
+			memcpy(spec + 1, fmt - n, n);
+			spec[n + 1] = '\0';
+		}
+		else
+		{
+			memcpy(spec, p, n);
+			spec[n] = '\0';
+		}
+		switch (arg)
+		{
+		case LOG_ARG_NONE:
+			break;
+		case LOG_ARG_INT:
+			LOG_EMIT(int);
+			break;
+		case LOG_ARG_LONG:
+			LOG_EMIT(long);
+			break;
+		case LOG_ARG_LLONG:
+			LOG_EMIT(long long);
+			break;
+		case LOG_ARG_SIZE:
+			LOG_EMIT(size_t);
+			break;
+		case LOG_ARG_INTMAX:
+			LOG_EMIT(intmax_t);
+			break;
+		case LOG_ARG_PTRDIFF:
+			LOG_EMIT(ptrdiff_t);
+			break;
+		case LOG_ARG_DOUBLE:
+			LOG_EMIT(double);
+			break;
+		case LOG_ARG_LDOUBLE:
+			LOG_EMIT(long double);
+			break;
+		case LOG_ARG_PTR:
+			LOG_EMIT(void *);
+			break;
+		case LOG_ARG_STR:
+			LOG_GET(uint32_t, len);
+			if (stars == 0)
+				printf(spec, args);
+			else if (stars == 1)
+				printf(spec, star[0], args);
+			else
+				printf(spec, star[0], star[1], args);
+			args += LOG_ALIGN(len + 1);
+			break;
+		}
+	}
+	fputs(fmt, stdout);
+}
+
+static struct log_chunk *new_chunk(uint32_t need)
+{
+	uint32_t size = need > LOG_CHUNK_SIZE ? need : LOG_CHUNK_SIZE;
+	struct log_chunk *c = malloc(sizeof(struct log_chunk) + size);
+
+	c->next = NULL;
+	c->used = 0;
+	c->size = size;
+	return c;
+}
+
+static struct log_buf *get_buf(void)
+{
+	if (my_buf == NULL)
+	{
+		my_buf = calloc(1, sizeof(struct log_buf));
+		my_buf->head = my_buf->tail = new_chunk(0);
+		pthread_mutex_lock(&log_lock);
+		my_buf->next = log_bufs;
+		__atomic_store_n(&log_bufs, my_buf, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&log_lock);
+	}
+	return my_buf;
+}
+
+static void log_append(uint32_t id, const char *text, uint32_t len)
+{
+	struct log_buf *b = get_buf();
+	struct log_chunk *c = b->tail;
+	uint32_t need = sizeof(struct log_rec) + LOG_ALIGN(len);
+	struct log_rec *rec;
+
+	if (c->size - c->used < need)
+	{
+		struct log_chunk *n = new_chunk(need);
+
+		__atomic_store_n(&c->next, n, __ATOMIC_RELEASE);
+		b->tail = c = n;
+	}
+	rec = (struct log_rec *)(c->data + c->used);
+	rec->slot = current_time();
+	rec->id = id;
+	rec->len = len;
+	memcpy(rec + 1, text, len);
+	__atomic_store_n(&c->used, c->used + need, __ATOMIC_RELEASE);
+}
+
+/* Next record of [b] not written out yet, NULL if none */
+static struct log_rec *log_peek(struct log_buf *b)
+{
+	struct log_chunk *c = b->head, *next;
+
+	while (b->read == __atomic_load_n(&c->used, __ATOMIC_ACQUIRE))
+	{
+		next = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE);
+		if (next == NULL)
+			return NULL;
+		/* The thread is done with c, used is final now */
+		if (b->read != __atomic_load_n(&c->used, __ATOMIC_ACQUIRE))
+			break;
+		b->head = next;
+		b->read = 0;
+		free(c);
+		c = next;
+	}
+	return (struct log_rec *)(c->data + b->read);
+}
+
+/* Write out the records of the slots before [until] in order. Records
+ * of one buffer are in slot order, so merging the heads is enough */
+static void log_drain(uint64_t until)
+{
+	struct log_buf *bufs = __atomic_load_n(&log_bufs, __ATOMIC_ACQUIRE);
+	struct log_buf *b, *best;
+	struct log_rec *rec, *best_rec;
+
+	while (1)
+	{
+		best = NULL;
+		best_rec = NULL;
+		for (b = bufs; b != NULL; b = b->next)
+		{
+			rec = log_peek(b);
+			if (rec == NULL || rec->slot >= until)
+				continue;
+			if (best == NULL || rec->slot < best_rec->slot ||
+			    (rec->slot == best_rec->slot && rec->id < best_rec->id))
+			{
+				best = b;
+				best_rec = rec;
+			}
+		}
+		if (best == NULL)
+			break;
+		log_format(best_rec);
+		best->read += sizeof(struct log_rec) + LOG_ALIGN(best_rec->len);
+	}
+}
+
+static void *log_routine(void *arg)
+{
+	struct timespec period = {0, LOG_DRAIN_NS};
+
+	while (!__atomic_load_n(&log_stop, __ATOMIC_ACQUIRE))
+	{
+		nanosleep(&period, NULL);
+		/* Threads are past every slot before the current one */
+		log_drain(current_time());
+	}
+	return NULL;
+}
+
+void log_init(void)
+{
+	log_stop = 0;
+	log_running = 1;
+	pthread_create(&log_writer, NULL, log_routine, NULL);
+}
+
+void log_finish(void)
+{
+	struct log_buf *b;
+
+	if (!log_running)
+		return;
+	__atomic_store_n(&log_stop, 1, __ATOMIC_RELEASE);
+	pthread_join(log_writer, NULL);
+	log_drain(UINT64_MAX);
+	fflush(stdout);
+	log_running = 0;
+
+	while (log_bufs != NULL)
+	{
+		b = log_bufs;
+		log_bufs = b->next;
+		while (b->head != NULL)
+		{
+			struct log_chunk *c = b->head;
+
+			b->head = c->next;
+			free(c);
+		}
+		free(b);
+	}
+	my_buf = NULL;
+}
+
+void log_thread(int id)
+{
+	my_id = id;
+}
+
+int log_select(const char *names)
+{
+	uint32_t mask = 0;
+	char name[16];
+	int i, n;
+
+	while (sscanf(names, " %15[^,]%n", name, &n) == 1)
+	{
+		for (i = 0; i < LOG_NR_CATS; i++)
+			if (strcmp(name, log_names[i]) == 0)
+				break;
+		if (i == LOG_NR_CATS)
+			return -1;
+		mask |= 1u << i;
+		names += n;
+		if (*names == ',')
+			names++;
+	}
+	__atomic_store_n(&log_mask, mask, __ATOMIC_RELAXED);
+	return 0;
+}
+
+void log_printf(enum log_cat cat, const char *fmt, ...)
+{
+	char msg[LOG_ARGS_MAX], *text = msg;
+	va_list ap;
+	size_t len;
+
+	if (!(__atomic_load_n(&log_mask, __ATOMIC_RELAXED) & (1u << cat)))
+		return;
+	va_start(ap, fmt);
+	if (!log_running)
+	{
+		vprintf(fmt, ap);
+		va_end(ap);
+		return;
+	}
+	/* The format pointer, then the arguments */
+	memcpy(msg, &fmt, sizeof(fmt));
+	len = sizeof(fmt) + log_pack(msg + sizeof(fmt), sizeof(msg) - sizeof(fmt),
+				     fmt, ap);
+	va_end(ap);
+	if (len > sizeof(msg))
+	{
+		text = malloc(len);
+		memcpy(text, &fmt, sizeof(fmt));
+		va_start(ap, fmt);
+		log_pack(text + sizeof(fmt), len - sizeof(fmt), fmt, ap);
+		va_end(ap);
+	}
+	log_append(cat == LOG_TIME ? 0 : my_id, text, len);
+	if (text != msg)
+		free(text);
+}
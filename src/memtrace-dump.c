@@ -0,0 +1,236 @@
+/*
+ * memtrace-dump - print the memory dumps of a trace written with os -M
+ *
+ * Usage: memtrace-dump [-c] [-p pid] [-s from:to] trace-file
+ *   default : the IODUMP text the simulator would have printed after each
+ *             alloc, free, read and write
+ *   -c      : CSV, one line per operation
+ *   -p pid  : operations of that process only
+ *   -s from:to : operations in the time slots from to to - 1 only
+ *
+ * The whole trace is replayed whatever the filters, the dumps show the
+ * state at the time of the operation.
+ */
+
+#include "memtrace.h"
+#include "mm.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define USAGE "Usage: memtrace-dump [-c] [-p pid] [-s from:to] trace-file\n"
+
+/* What the dumps of a process show */
+struct proc_state {
+	uint32_t *pgd;		// NULL until the process shows up
+	uint32_t vm_end;	// End of vma 0
+};
+
+static struct proc_state *procs;
+static uint32_t nr_procs;
+static BYTE *ram;		// Same type as the storage, for the same output
+static uint32_t ram_size;
+
+static struct proc_state *get_proc(uint32_t pid)
+{
+	if (pid >= nr_procs)
+	{
+		uint32_t n = nr_procs ? nr_procs : 64;
+
+		while (n <= pid)
+			n *= 2;
+		procs = realloc(procs, sizeof(struct proc_state) * n);
+		memset(procs + nr_procs, 0, sizeof(struct proc_state) * (n - nr_procs));
+		nr_procs = n;
+	}
+	if (procs[pid].pgd == NULL)
+		procs[pid].pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
+	return &procs[pid];
+}
+
+static const char *op_name(int op)
+{
+	switch (op)
+	{
+	case MTRACE_ALLOC:
+		return "alloc";
+	case MTRACE_FREE:
+		return "free";
+	case MTRACE_READ:
+		return "read";
+	case MTRACE_WRITE:
+		return "write";
+	default:
+		return "?";
+	}
+}
+
+/* Same output as print_pgtbl(proc, 0, -1) and print_page_frame_mapping() */
+static void print_tables(struct proc_state *p)
+{
+	int pgit;
+
+#ifdef PAGETBL_DUMP
+	printf("print_pgtbl: %d - %d\n", 0, p->vm_end);
+	for (pgit = 0; pgit < PAGING_PGN(p->vm_end); pgit++)
+		printf("%08ld: %08x\n", pgit * sizeof(uint32_t), p->pgd[pgit]);
+#endif
+	for (pgit = 0; pgit < PAGING_MAX_PGN; pgit++)
+		if (PAGING_PAGE_PRESENT(p->pgd[pgit]))
+			printf("Page Number: %d -> Frame Number: %d\n", pgit,
+			       (int)PAGING_FPN(p->pgd[pgit]));
+}
+
+/* Same output as MEMPHY_dump() of MEMRAM */
+static void print_ram(void)
+{
+	uint32_t i;
+
+	printf("===== PHYSICAL MEMORY DUMP =====\n");
+	for (i = 0; i < ram_size; i++)
+		if (ram[i] != 0)
+			printf("BYTE %08X: %u\n", i, ram[i]);
+	printf("===== PHYSICAL MEMORY END-DUMP =====\n");
+	printf("================================================================\n");
+}
+
+static void print_dump(const struct memtrace_rec *r, struct proc_state *p)
+{
+	switch (r->op)
+	{
+	case MTRACE_ALLOC:
+		printf("===== PHYSICAL MEMORY AFTER ALLOCATION =====\n");
+		printf("PID=%d - Region=%d - Address=%08X - Size=%d byte\n",
+		       r->pid, r->region, r->vaddr, r->value);
+		break;
+	case MTRACE_FREE:
+		printf("===== PHYSICAL MEMORY AFTER DEALLOCATION =====\n");
+		printf("PID=%d - Region=%d\n", r->pid, r->region);
+		break;
+	case MTRACE_READ:
+		/* A failed read prints nothing */
+		if (r->flags & MTRACE_FAILED)
+			return;
+		printf("===== PHYSICAL MEMORY AFTER READING =====\n");
+		printf("read region=%d offset=%d value=%d\n", r->region, r->arg, r->value);
+		break;
+	case MTRACE_WRITE:
+		printf("===== PHYSICAL MEMORY AFTER WRITING =====\n");
+		printf("write region=%d offset=%d value=%d\n", r->region, r->arg, r->value);
+		break;
+	}
+	print_tables(p);
+	printf("================================================================\n");
+	if (r->op == MTRACE_READ || r->op == MTRACE_WRITE)
+		print_ram();
+}
+
+int main(int argc, char *argv[])
+{
+	const struct memtrace_header *hdr;
+	const struct memtrace_rec *recs, *r;
+	struct proc_state *p;
+	uint32_t from = 0, to = UINT32_MAX;
+	long pid = -1;
+	int csv = 0, opt, fd;
+	struct stat st;
+	uint64_t i, nr;
+	void *map;
+
+	while ((opt = getopt(argc, argv, "cp:s:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'c':
+			csv = 1;
+			break;
+		case 'p':
+			pid = atol(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%u:%u", &from, &to) != 2)
+			{
+				printf(USAGE);
+				return 1;
+			}
+			break;
+		default:
+			printf(USAGE);
+			return 1;
+		}
+	}
+	if (optind != argc - 1)
+	{
+		printf(USAGE);
+		return 1;
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		printf("Cannot open %s\n", argv[optind]);
+		return 1;
+	}
+	map = st.st_size >= (off_t)sizeof(*hdr) ?
+		mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	hdr = map;
+	if (map == MAP_FAILED ||
+	    memcmp(hdr->magic, MEMTRACE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != MEMTRACE_VERSION ||
+	    hdr->rec_size != sizeof(struct memtrace_rec) ||
+	    hdr->page_size != PAGING_PAGESZ)
+	{
+		printf("%s is not a memory trace\n", argv[optind]);
+		return 1;
+	}
+	recs = (const struct memtrace_rec *)(hdr + 1);
+	nr = (st.st_size - sizeof(*hdr)) / sizeof(struct memtrace_rec);
+	if (hdr->nr_recs < nr)
+		nr = hdr->nr_recs;
+	ram_size = hdr->ram_size;
+	ram = calloc(ram_size, 1);
+
+	if (csv)
+		printf("slot,op,pid,region,vaddr,pgn,fpn,value,arg,fault,failed\n");
+	for (i = 0; i < nr; i++)
+	{
+		r = &recs[i];
+		switch (r->op)
+		{
+		case MTRACE_PTE:
+			if (r->pgn < PAGING_MAX_PGN)
+				get_proc(r->pid)->pgd[r->pgn] = r->value;
+			break;
+		case MTRACE_BRK:
+			get_proc(r->pid)->vm_end = r->value;
+			break;
+		case MTRACE_BYTE:
+			if (r->vaddr < ram_size)
+				ram[r->vaddr] = r->value;
+			break;
+		default:
+			p = get_proc(r->pid);
+			if ((pid >= 0 && r->pid != pid) || r->slot < from || r->slot >= to)
+				break;
+			if (csv)
+				printf("%u,%s,%u,%u,%u,%u,%u,%d,%u,%d,%d\n", r->slot,
+				       op_name(r->op), r->pid, r->region, r->vaddr,
+				       r->pgn, r->fpn, r->value, r->arg,
+				       !!(r->flags & MTRACE_FAULT),
+				       !!(r->flags & MTRACE_FAILED));
+			else
+				print_dump(r, p);
+		}
+	}
+	munmap(map, st.st_size);
+	free(ram);
+	for (i = 0; i < nr_procs; i++)
+		free(procs[i].pgd);
+	free(procs);
+	return 0;
+}
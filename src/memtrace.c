@@ -0,0 +1,186 @@
+/*
+ * Memory event trace, see memtrace.h
+ */
+
+#include "memtrace.h"
+#include "mm.h"
+#include "timer.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ *  The file is mapped in segments that stay mapped until the trace is
+ *  closed, so a writer only needs the segment of the slot it reserved.
+ *  Slot 0 holds the header, record i is in slot i + 1.
+ */
+#define MEMTRACE_SEG_SIZE (1 << 22)
+#define MEMTRACE_SEG_RECS (MEMTRACE_SEG_SIZE / sizeof(struct memtrace_rec))
+#define MEMTRACE_MAX_SEGS 4096	// 16 GB of records
+
+_Static_assert(sizeof(struct memtrace_header) == sizeof(struct memtrace_rec),
+	       "the header takes the first record slot");
+
+struct memphy_struct *memtrace_ram;
+
+static int memtrace_fd = -1;
+static char *memtrace_segs[MEMTRACE_MAX_SEGS];
+static uint64_t memtrace_slots;		// Slots handed out, header included
+static uint64_t memtrace_lost;		// Records past the last segment
+static pthread_mutex_t memtrace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *map_seg(uint64_t seg)
+{
+	char *p;
+
+	if (seg >= MEMTRACE_MAX_SEGS)
+		return NULL;
+	p = __atomic_load_n(&memtrace_segs[seg], __ATOMIC_ACQUIRE);
+	if (p != NULL)
+		return p;
+
+	pthread_mutex_lock(&memtrace_lock);
+	p = memtrace_segs[seg];
+	if (p == NULL &&
+	    ftruncate(memtrace_fd, (off_t)(seg + 1) * MEMTRACE_SEG_SIZE) == 0)
+	{
+		p = mmap(NULL, MEMTRACE_SEG_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, memtrace_fd, (off_t)seg * MEMTRACE_SEG_SIZE);
+		if (p == MAP_FAILED)
+			p = NULL;
+		__atomic_store_n(&memtrace_segs[seg], p, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&memtrace_lock);
+	return p;
+}
+
+/* Reserve the next record, NULL if the trace is full */
+static struct memtrace_rec *next_rec(void)
+{
+	uint64_t i = __atomic_fetch_add(&memtrace_slots, 1, __ATOMIC_RELAXED);
+	char *seg = map_seg(i / MEMTRACE_SEG_RECS);
+
+	if (seg == NULL)
+	{
+		__atomic_add_fetch(&memtrace_lost, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	return (struct memtrace_rec *)seg + i % MEMTRACE_SEG_RECS;
+}
+
+/* Frame of [pte], 0 unless it is resident */
+static uint32_t pte_frame(uint32_t pte)
+{
+	if (!PAGING_PAGE_PRESENT(pte) || (pte & PAGING_PTE_SWAPPED_MASK))
+		return 0;
+	return PAGING_FPN(pte);
+}
+
+int memtrace_init(const char *path, struct memphy_struct *ram)
+{
+	memtrace_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (memtrace_fd < 0)
+		return -1;
+	memtrace_slots = 1;
+	memtrace_lost = 0;
+	if (map_seg(0) == NULL)
+	{
+		close(memtrace_fd);
+		memtrace_fd = -1;
+		return -1;
+	}
+	memtrace_ram = ram;
+	return 0;
+}
+
+void memtrace_finish(void)
+{
+	struct memtrace_header *hdr;
+	uint64_t seg, used;
+
+	if (memtrace_ram == NULL)
+		return;
+	used = memtrace_slots - memtrace_lost;
+	hdr = (struct memtrace_header *)memtrace_segs[0];
+	memcpy(hdr->magic, MEMTRACE_MAGIC, sizeof(hdr->magic));
+	hdr->version = MEMTRACE_VERSION;
+	hdr->rec_size = sizeof(struct memtrace_rec);
+	hdr->ram_size = memtrace_ram->maxsz;
+	hdr->nr_recs = used - 1;
+	hdr->page_size = PAGING_PAGESZ;
+
+	for (seg = 0; seg < MEMTRACE_MAX_SEGS && memtrace_segs[seg]; seg++)
+	{
+		munmap(memtrace_segs[seg], MEMTRACE_SEG_SIZE);
+		memtrace_segs[seg] = NULL;
+	}
+	if (ftruncate(memtrace_fd, (off_t)used * sizeof(struct memtrace_rec)) != 0)
+		printf("Cannot trim the memory trace\n");
+	close(memtrace_fd);
+	memtrace_fd = -1;
+	if (memtrace_lost)
+		printf("Memory trace full, %lu records lost\n", memtrace_lost);
+	memtrace_ram = NULL;
+}
+
+void memtrace_op(int op, struct pcb_t *proc, int region, uint32_t vaddr,
+		 uint32_t value, uint32_t arg, int flags)
+{
+	struct memtrace_rec *r;
+
+	if (memtrace_ram == NULL || (r = next_rec()) == NULL)
+		return;
+	r->slot = current_time();
+	r->op = op;
+	r->flags = flags;
+	r->region = region;
+	r->pid = proc->pid;
+	r->vaddr = vaddr;
+	r->pgn = PAGING_PGN(vaddr);
+	r->fpn = pte_frame(proc->mm->pgd[r->pgn]);
+	r->value = value;
+	r->arg = arg;
+}
+
+void memtrace_pte(struct pcb_t *proc, int pgn)
+{
+	struct memtrace_rec *r;
+
+	if (memtrace_ram == NULL || (r = next_rec()) == NULL)
+		return;
+	r->slot = current_time();
+	r->op = MTRACE_PTE;
+	r->pid = proc->pid;
+	r->vaddr = pgn * PAGING_PAGESZ;
+	r->pgn = pgn;
+	r->value = proc->mm->pgd[pgn];
+	r->fpn = pte_frame(r->value);
+}
+
+void memtrace_brk(struct pcb_t *proc)
+{
+	struct memtrace_rec *r;
+
+	if (memtrace_ram == NULL || (r = next_rec()) == NULL)
+		return;
+	r->slot = current_time();
+	r->op = MTRACE_BRK;
+	r->pid = proc->pid;
+	r->value = get_vma_by_num(proc->mm, 0)->vm_end;
+}
+
+void memtrace_put_byte(int addr, BYTE value)
+{
+	struct memtrace_rec *r;
+
+	if ((r = next_rec()) == NULL)
+		return;
+	r->slot = current_time();
+	r->op = MTRACE_BYTE;
+	r->vaddr = addr;
+	r->fpn = addr / PAGING_PAGESZ;
+	r->value = value;
+}
@@ -5,6 +5,8 @@
  */
 
 #include "mm.h"
+#include "log.h"
+#include "memtrace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -100,9 +102,10 @@ int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data)
    if (mp == NULL)
       return -1;
 
-   if (mp->rdmflg)
+   if (mp->rdmflg) {
+      memtrace_byte(mp, addr, mp->storage[addr], data);
       mp->storage[addr] = data;
-   else /* Sequential access device */
+   } else /* Sequential access device */
       return MEMPHY_seq_write(mp, addr, data);
 
    return 0;
@@ -126,6 +129,7 @@ int MEMPHY_format(struct memphy_struct *mp, int pagesz)
    fst = malloc(sizeof(struct framephy_struct));
    fst->fpn = iter;
    mp->free_fp_list = fst;
+   mp->free_fp_cnt = numfp;
 
    /* We have list with first element, fill in the rest num-1 element member*/
    for (iter = 1; iter < numfp; iter++)
@@ -149,6 +153,7 @@ int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
 
    *retfpn = fp->fpn;
    mp->free_fp_list = fp->fp_next;
+   mp->free_fp_cnt--;
 
    /* MEMPHY is iteratively used up until its exhausted
     * No garbage collector acting then it not been released
@@ -161,16 +166,16 @@ int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
 
 int MEMPHY_dump(struct memphy_struct *mp)
 {
-   printf("===== PHYSICAL MEMORY DUMP =====\n");
+   log_printf(LOG_DUMP, "===== PHYSICAL MEMORY DUMP =====\n");
 
    for (int i = 0; i < mp->maxsz; i++) {
       BYTE val = mp->storage[i];
       if (val != 0) {
-            printf("BYTE %08X: %u\n", i, val);
+            log_printf(LOG_DUMP, "BYTE %08X: %u\n", i, val);
       }
    }
-   printf("===== PHYSICAL MEMORY END-DUMP =====\n");
-   printf("================================================================\n");
+   log_printf(LOG_DUMP, "===== PHYSICAL MEMORY END-DUMP =====\n");
+   log_printf(LOG_DUMP, "================================================================\n");
    return 0;
 }
 
@@ -183,10 +188,20 @@ int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
    newnode->fpn = fpn;
    newnode->fp_next = fp;
    mp->free_fp_list = newnode;
+   mp->free_fp_cnt++;
 
    return 0;
 }
 
+/*
+ *  MEMPHY_nr_freefp - number of free frames
+ *  @mp: memphy struct
+ */
+int MEMPHY_nr_freefp(struct memphy_struct *mp)
+{
+   return __atomic_load_n(&mp->free_fp_cnt, __ATOMIC_RELAXED);
+}
+
 /*
  *  Init MEMPHY struct
  */
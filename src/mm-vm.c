@@ -6,6 +6,7 @@
 
 #include "string.h"
 #include "mm.h"
+#include "memtrace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -111,8 +112,11 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)   ///
 
   //cur_vma->vm_end = area->rg_end;
   cur_vma->sbrk = area->rg_end;
-  if (cur_vma->sbrk > cur_vma->vm_end)
+  if (cur_vma->sbrk > cur_vma->vm_end) {
     cur_vma->vm_end = cur_vma->sbrk;
+    if (vmaid == 0)
+      memtrace_brk(caller);
+  }
 
   if (vm_map_ram(caller, area->rg_start, area->rg_end, 
                 area->rg_start, incnumpage , newrg) < 0)
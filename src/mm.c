@@ -5,6 +5,8 @@
  */
 
 #include "mm.h"
+#include "log.h"
+#include "memtrace.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -142,6 +144,7 @@ if (fpit == NULL) break; // Tránh lỗi nếu hết frame trước khi ánh x
 // Lưu thông tin vào bảng trang
 uint32_t *pte = &caller->mm->pgd[pgn + pgit]; 
 pte_set_fpn(pte, fpit->fpn); // Thiết lập số hiệu khung trang vào PTE
+memtrace_pte(caller, pgn + pgit);
 
 // Ghi nhận trang vào danh sách FIFO (dùng cho thay thế trang sau này)
 enlist_pgn_node(&caller->mm->fifo_pgn, pgn + pgit);
@@ -249,7 +252,7 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
   if (ret_alloc == -3000)
   {
 #ifdef MMDBG
-    printf("OOM: vm_map_ram out of memory \n");
+    log_printf(LOG_MEM, "OOM: vm_map_ram out of memory \n");
 #endif
     return -1;
   }
@@ -301,6 +304,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma0->vm_start = 0;
   vma0->vm_end = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
+  vma0->vm_freerg_list = NULL;
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
 
@@ -350,15 +354,15 @@ int print_list_fp(struct framephy_struct *ifp)
 {
   struct framephy_struct *fp = ifp;
 
-  printf("print_list_fp: ");
-  if (fp == NULL) { printf("NULL list\n"); return -1;}
-  printf("\n");
+  log_printf(LOG_DUMP, "print_list_fp: ");
+  if (fp == NULL) { log_printf(LOG_DUMP, "NULL list\n"); return -1;}
+  log_printf(LOG_DUMP, "\n");
   while (fp != NULL)
   {
-    printf("fp[%d]\n", fp->fpn);
+    log_printf(LOG_DUMP, "fp[%d]\n", fp->fpn);
     fp = fp->fp_next;
   }
-  printf("\n");
+  log_printf(LOG_DUMP, "\n");
   return 0;
 }
 
@@ -366,15 +370,15 @@ int print_list_rg(struct vm_rg_struct *irg)
 {
   struct vm_rg_struct *rg = irg;
 
-  printf("print_list_rg: ");
-  if (rg == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  log_printf(LOG_DUMP, "print_list_rg: ");
+  if (rg == NULL) { log_printf(LOG_DUMP, "NULL list\n"); return -1; }
+  log_printf(LOG_DUMP, "\n");
   while (rg != NULL)
   {
-    printf("rg[%ld->%ld]\n", rg->rg_start, rg->rg_end);
+    log_printf(LOG_DUMP, "rg[%ld->%ld]\n", rg->rg_start, rg->rg_end);
     rg = rg->rg_next;
   }
-  printf("\n");
+  log_printf(LOG_DUMP, "\n");
   return 0;
 }
 
@@ -382,29 +386,29 @@ int print_list_vma(struct vm_area_struct *ivma)
 {
   struct vm_area_struct *vma = ivma;
 
-  printf("print_list_vma: ");
-  if (vma == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  log_printf(LOG_DUMP, "print_list_vma: ");
+  if (vma == NULL) { log_printf(LOG_DUMP, "NULL list\n"); return -1; }
+  log_printf(LOG_DUMP, "\n");
   while (vma != NULL)
   {
-    printf("va[%ld->%ld]\n", vma->vm_start, vma->vm_end);
+    log_printf(LOG_DUMP, "va[%ld->%ld]\n", vma->vm_start, vma->vm_end);
     vma = vma->vm_next;
   }
-  printf("\n");
+  log_printf(LOG_DUMP, "\n");
   return 0;
 }
 
 int print_list_pgn(struct pgn_t *ip)
 {
-  printf("print_list_pgn: ");
-  if (ip == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  log_printf(LOG_DUMP, "print_list_pgn: ");
+  if (ip == NULL) { log_printf(LOG_DUMP, "NULL list\n"); return -1; }
+  log_printf(LOG_DUMP, "\n");
   while (ip != NULL)
   {
-    printf("va[%d]-\n", ip->pgn);
+    log_printf(LOG_DUMP, "va[%d]-\n", ip->pgn);
     ip = ip->pg_next;
   }
-  printf("n");
+  log_printf(LOG_DUMP, "n");
   return 0;
 }
 
@@ -422,13 +426,13 @@ int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
   pgn_start = PAGING_PGN(start);
   pgn_end = PAGING_PGN(end);
 
-  printf("print_pgtbl: %d - %d", start, end);
-  if (caller == NULL) { printf("NULL caller\n"); return -1;}
-  printf("\n");
+  log_printf(LOG_DUMP, "print_pgtbl: %d - %d", start, end);
+  if (caller == NULL) { log_printf(LOG_DUMP, "NULL caller\n"); return -1;}
+  log_printf(LOG_DUMP, "\n");
 
   for (pgit = pgn_start; pgit < pgn_end; pgit++)
   {
-    printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
+    log_printf(LOG_DUMP, "%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
   }
 
   return 0;
@@ -4,15 +4,23 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "trace.h"
+#include "memtrace.h"
+#include "log.h"
 
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 static int time_slot;
 static int num_cpus;
+static int *cpu_speed;	// Instructions per slot of each CPU
 static int done = 0;
+static int fast_forward = 0;	// Skip the slots every CPU is parked in
+static int serial = 0;		// Single-threaded engine, see run_serial()
+static int replay = 0;		// The scheduler follows a trace, see run_replay()
 
 #ifdef MM_PAGING
 static int memramsz;
@@ -36,6 +44,11 @@ static struct ld_args
 	unsigned long *start_time;
 #ifdef MLQ_SCHED
 	unsigned long *prio;
+	unsigned long *deadline;	// Relative to the arrival, 0 = none
+	unsigned long *affinity;	// CPU mask, 0 = any CPU
+	unsigned long *tickets;		// Stride share, 0 = from prio
+	char (*group)[32];		// Bandwidth group name, "" = none
+	int *group_id;
 #endif
 } ld_processes;
 int num_processes;
@@ -46,126 +59,420 @@ struct cpu_args
 	int id;
 };
 
+/*
+ *  Per-CPU utilization timeline, one state per time slot
+ *  Each CPU only writes its own timeline. Slots it never recorded, such
+ *  as the ones it slept through parked or after it stopped, are idle.
+ */
+enum slot_state
+{
+	SLOT_IDLE,
+	SLOT_BUSY,	// Ran instructions
+	SLOT_MEM,	// Ran at least one memory instruction
+};
+
+static struct cpu_timeline
+{
+	uint8_t *slot;
+	uint64_t len;
+	uint64_t cap;
+} *timelines;
+
+static void timeline_mark(int id, uint64_t t, enum slot_state state)
+{
+	struct cpu_timeline *tl = &timelines[id];
+
+	if (t >= tl->cap)
+	{
+		uint64_t cap = tl->cap ? tl->cap : 256;
+
+		while (cap <= t)
+			cap *= 2;
+		tl->slot = realloc(tl->slot, cap);
+		memset(tl->slot + tl->cap, SLOT_IDLE, cap - tl->cap);
+		tl->cap = cap;
+	}
+	tl->slot[t] = state;
+	if (t >= tl->len)
+		tl->len = t + 1;
+}
+
+static int mem_inst(struct pcb_t *proc)
+{
+	enum ins_opcode_t op = proc->code->text[proc->pc].opcode;
+
+	return op == ALLOC || op == FREE || op == READ || op == WRITE;
+}
+
+/* What a CPU did in its turn of a slot */
+enum cpu_step_result
+{
+	CPU_RAN,	// Ran its process for the slot
+	CPU_IDLE,	// Found nothing to run
+	CPU_STOPPED,	// Nothing left to run at all
+};
+
+struct cpu_state
+{
+	struct pcb_t *proc;	// Running process, NULL when idle
+	int time_left;		// Slots left in its quantum
+	int stopped;
+};
+
+/* Take the turn of CPU [id] in the current slot, the caller moves on to
+ * the next slot */
+static enum cpu_step_result cpu_step(int id, struct cpu_state *cs)
+{
+	struct pcb_t *proc = cs->proc;
+	enum slot_state state;
+	int i;
+
+	/* Check the status of current process */
+	if (proc == NULL)
+	{
+		/* No process is running, the we load new process from
+		 * ready queue */
+		proc = get_proc(id);
+		/* Fall through to the recheck below so that an idle CPU
+		 * also notices when the loader is done */
+	}
+	else if (proc->pc == proc->code->size)
+	{
+		/* The porcess has finish it job */
+		log_printf(LOG_SCHED, "\tCPU %d: Processed %2d has finished\n",
+			   id, proc->pid);
+		finish_proc(id, proc);
+#ifdef MM_PAGING
+		free_pcb_memph(proc);
+#endif
+		free(proc);
+		proc = get_proc(id);
+		cs->time_left = 0;
+	}
+	else if (cs->time_left == 0 || need_resched(id))
+	{
+		/* The process has done its job in current time slot, or
+		 * a process with an earlier deadline has arrived */
+		cs->time_left = 0;
+		log_printf(LOG_SCHED, "\tCPU %d: Put process %2d to run queue\n",
+			   id, proc->pid);
+		put_proc(id, proc);
+		proc = get_proc(id);
+	}
+	cs->proc = proc;
+
+	/* Recheck process status after loading new process */
+	if (proc == NULL && done && queue_empty() && !sched_keep_cpu(id))
+	{
+		/* No process to run and none left queued (throttled
+		 * processes wait for their group period), exit. A faster
+		 * CPU waits for the processes of the slower ones */
+		log_printf(LOG_SCHED, "\tCPU %d stopped\n", id);
+		return CPU_STOPPED;
+	}
+	else if (proc == NULL)
+	{
+		/* There may be new processes to run in next time slots */
+		return CPU_IDLE;
+	}
+	else if (cs->time_left == 0)
+	{
+		log_printf(LOG_SCHED, "\tCPU %d: Dispatched process %2d\n",
+			   id, proc->pid);
+		cs->time_left = sched_quantum(proc, time_slot);
+	}
+
+	/* Run current process, cpu_speed[id] instructions per slot */
+	state = SLOT_BUSY;
+	for (i = 0; i < cpu_speed[id] && proc->pc != proc->code->size; i++)
+	{
+		if (mem_inst(proc))
+			state = SLOT_MEM;
+		run(proc);
+	}
+	timeline_mark(id, current_time(), state);
+	sched_tick(id, proc);
+	cs->time_left--;
+	return CPU_RAN;
+}
+
 static void *cpu_routine(void *args)
 {
 	struct timer_id_t *timer_id = ((struct cpu_args *)args)->timer_id;
 	int id = ((struct cpu_args *)args)->id;
+	struct cpu_state cs = {NULL, 0, 0};
+
+	log_thread(LOG_ID_CPU(id));
 	/* Check for new process in ready queue */
 	// printf("\nIn cpu_routine, CPU = %d\n", id);
-	int time_left = 0;
-	struct pcb_t *proc = NULL;
 	while (1)
 	{
-		// printf("in cpu. 1\n");
-		/* Check the status of current process */
-		if (proc == NULL)
-		{
-			/* No process is running, the we load new process from
-			 * ready queue */
-			// printf("\nGet_proc\n");
-			proc = get_proc();
-			// if(proc == NULL) printf("\nProcess null\n");
-			if (proc == NULL)
-			{
-				next_slot(timer_id);
-				continue; /* First load failed. skip dummy load */
-			}
-		}
-		else if (proc->pc == proc->code->size)
-		{
-			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				   id, proc->pid);
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}
-		else if (time_left == 0)
-		{
-			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				   id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
-		}
+		enum cpu_step_result res = cpu_step(id, &cs);
 
-		/* Recheck process status after loading new process */
-		if (proc == NULL && done)
-		{
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
+		if (res == CPU_STOPPED)
 			break;
-		}
-		else if (proc == NULL)
-		{
-			/* There may be new processes to run in
-			 * next time slots, just skip current slot */
+		else if (res == CPU_IDLE)
+			/* Sleep until the scheduler has work */
+			sched_park(id, timer_id);
+		else
 			next_slot(timer_id);
-			continue;
-		}
-		else if (time_left == 0)
-		{
-			printf("\tCPU %d: Dispatched process %2d\n",
-				   id, proc->pid);
-			time_left = time_slot;
-		}
-
-		/* Run current process */
-		run(proc);
-		time_left--;
-		next_slot(timer_id);
 	}
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/* Load process [i] of the configuration */
+static struct pcb_t *ld_load(int i)
+{
+	struct pcb_t *proc = load(ld_processes.path[i]);
+#ifdef MLQ_SCHED
+	proc->prio = ld_processes.prio[i];
+#endif
+	return proc;
+}
+
+/* Set up process [i] of the configuration, just loaded, for running */
+static void ld_prepare(int i, struct pcb_t *proc, void *args)
+{
+#ifdef MM_PAGING
+	struct mmpaging_ld_args *mm_args = (struct mmpaging_ld_args *)args;
+
+	proc->mm = calloc(1, sizeof(struct mm_struct));
+	init_mm(proc->mm, proc);
+	proc->mram = mm_args->mram;
+	proc->mswp = mm_args->mswp;
+	proc->active_mswp = mm_args->active_mswp;
+#endif
+	log_printf(LOG_SCHED, "\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+		   ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+#ifdef MLQ_SCHED
+	if (ld_processes.deadline[i])
+		proc->deadline = current_time() + ld_processes.deadline[i];
+	proc->affinity = ld_processes.affinity[i];
+	proc->tickets = ld_processes.tickets[i];
+	proc->group = ld_processes.group_id[i];
+#endif
+	free(ld_processes.path[i]);
+}
+
+/* Every process is admitted, let the idle CPUs stop */
+static void ld_finish(void)
+{
+	free(ld_processes.path);
+	free(ld_processes.start_time);
+#ifdef MLQ_SCHED
+	free(ld_processes.prio);
+	free(ld_processes.deadline);
+	free(ld_processes.affinity);
+	free(ld_processes.tickets);
+	free(ld_processes.group);
+	free(ld_processes.group_id);
+#endif
+	done = 1;
+	sched_unpark_all();
+}
+
 static void *ld_routine(void *args)
 {
 #ifdef MM_PAGING
-	struct memphy_struct *mram = ((struct mmpaging_ld_args *)args)->mram;
-	struct memphy_struct **mswp = ((struct mmpaging_ld_args *)args)->mswp;
-	struct memphy_struct *active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
 	struct timer_id_t *timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
 #else
 	struct timer_id_t *timer_id = (struct timer_id_t *)args;
 #endif
 	int i = 0;
-	printf("ld_routine\n");
+	log_thread(LOG_ID_LOADER);
+	log_printf(LOG_SCHED, "ld_routine\n");
 	// printf("Number of processes: %d", num_processes);
 
 	while (i < num_processes)
 	{
 		// printf("in ld routine. 1\n");
-		struct pcb_t *proc = load(ld_processes.path[i]);
-#ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
-#endif
+		struct pcb_t *proc = ld_load(i);
 		while (current_time() < ld_processes.start_time[i])
 		{
+			/* With every CPU parked nothing happens until the
+			 * arrival, go straight to it */
+			if (fast_forward &&
+			    skip_slots(timer_id, ld_processes.start_time[i]))
+				break;
 			next_slot(timer_id);
 			// printf("	After next_slot: Current time: %lu\n", current_time());
 		}
 #ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
+		/* Admission control, wait for the swapper to free MEMRAM */
+		while (sched_mem_pressure())
+			next_slot(timer_id);
 #endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			   ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+		ld_prepare(i, proc, args);
 		add_proc(proc);
-		free(ld_processes.path[i]);
 		i++;
 		next_slot(timer_id);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	ld_finish();
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/* Whether process [next] of the configuration is admitted in this slot */
+static int ld_due(int next, uint64_t now)
+{
+	if (replay)
+		return sched_replay_admit() == 1;
+#ifdef MM_PAGING
+	/* Admission control, wait for the swapper to free MEMRAM */
+	if (sched_mem_pressure())
+		return 0;
+#endif
+	return now >= ld_processes.start_time[next];
+}
+
+/*
+ *  Single-threaded engine
+ *  The loader, then CPU 0 to N - 1 take their turn in every slot, always
+ *  in that order, so the output only depends on the configuration. While
+ *  every CPU is idle with nothing queued, the next arrival is the only
+ *  event left and the time jumps straight to it.
+ */
+static void run_serial(void *ld_args)
+{
+	struct cpu_state *cs = calloc(num_cpus, sizeof(struct cpu_state));
+	int nr_running = num_cpus;	// CPUs not stopped yet
+	int next = 0;			// Next process to admit
+	int i, busy;
+	uint64_t now;
+
+	log_printf(LOG_SCHED, "ld_routine\n");
+	while (1)
+	{
+		now = current_time();
+		if (next < num_processes && ld_due(next, now))
+		{
+			struct pcb_t *proc = ld_load(next);
+
+			ld_prepare(next++, proc, ld_args);
+			add_proc(proc);
+		}
+		/* A trace cut short admits only the first processes */
+		if (replay && sched_replay_admit() < 0)
+			for (; next < num_processes; next++)
+				free(ld_processes.path[next]);
+		if (next == num_processes && !done)
+			ld_finish();
+
+		busy = 0;
+		for (i = 0; i < num_cpus; i++)
+		{
+			if (cs[i].stopped)
+				continue;
+			switch (cpu_step(i, &cs[i]))
+			{
+			case CPU_STOPPED:
+				cs[i].stopped = 1;
+				nr_running--;
+				break;
+			case CPU_RAN:
+				busy = 1;
+				break;
+			default:
+				break;
+			}
+		}
+		if (nr_running == 0)
+			break;
+
+		if (!busy && next < num_processes && queue_empty() &&
+		    ld_processes.start_time[next] > now + 1)
+			step_slots(ld_processes.start_time[next]);
+		else
+			step_slots(now + 1);
+	}
+	free(cs);
+}
+
+/*
+ *  Replay of a scheduler trace written with -t
+ *  run_serial() with the scheduler following the trace instead of the
+ *  policy, see sched_replay(). Processes are admitted, dispatched, put
+ *  back, throttled and swapped at the points the trace records, so the
+ *  replay of a -d run prints the same output as the run itself.
+ */
+static int run_replay(const char *path, void *ld_args)
+{
+	if (sched_replay(path) != 0)
+	{
+		printf("%s is not a scheduler trace of %d CPUs\n", path, num_cpus);
+		return -1;
+	}
+	replay = 1;
+	run_serial(ld_args);
+	return 0;
+}
+
+#ifdef MLQ_SCHED
+/*
+ *  Optional per-process columns following the priority, as key=value
+ *  deadline=N : EDF deadline, N slots after the process arrives
+ *  affinity=M : mask of the CPUs the process may run on, bit i for CPU i
+ *  tickets=N  : stride policy share, derived from the priority if absent
+ *  group=NAME : bandwidth group, declared after the process lines
+ */
+static void read_proc_opts(const char *opts, int i)
+{
+	char key[32], val[32];
+	int n;
+
+	ld_processes.deadline[i] = 0;
+	ld_processes.affinity[i] = 0;
+	ld_processes.tickets[i] = 0;
+	ld_processes.group[i][0] = '\0';
+	while (sscanf(opts, " %31[^= \t\n]=%31s%n", key, val, &n) == 2)
+	{
+		if (strcmp(key, "deadline") == 0)
+			ld_processes.deadline[i] = strtoul(val, NULL, 0);
+		else if (strcmp(key, "affinity") == 0)
+			ld_processes.affinity[i] = strtoul(val, NULL, 0);
+		else if (strcmp(key, "tickets") == 0)
+			ld_processes.tickets[i] = strtoul(val, NULL, 0);
+		else if (strcmp(key, "group") == 0)
+			strcpy(ld_processes.group[i], val);
+		else
+			printf("Unknown process option %s, ignored\n", key);
+		opts += n;
+	}
+}
+
+/*
+ *  Directive lines following the process lines
+ *  group NAME QUOTA PERIOD : bandwidth group, QUOTA slots every PERIOD
+ *  cpu ID SPEED            : CPU ID executes SPEED instructions per slot
+ */
+static void read_directives(FILE *file)
+{
+	char line[256], name[32];
+	int quota, period, cpu, speed;
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+		if (sscanf(line, " group %31s %d %d", name, &quota, &period) == 3)
+		{
+			if (sched_add_group(name, quota, period) < 0)
+				printf("Cannot add group %s\n", name);
+		}
+		else if (sscanf(line, " cpu %d %d", &cpu, &speed) == 2)
+		{
+			if (cpu >= 0 && cpu < num_cpus && speed > 0)
+				cpu_speed[cpu] = speed;
+			else
+				printf("Invalid CPU speed %s", line);
+		}
+		else
+			printf("Unknown directive %s", line);
+	}
+}
+#endif
+
 static void read_config(const char *path)
 {
 	FILE *file;
@@ -175,6 +482,10 @@ static void read_config(const char *path)
 		exit(1);
 	}
 	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
+	cpu_speed = (int *)malloc(sizeof(int) * num_cpus);
+	int cpu;
+	for (cpu = 0; cpu < num_cpus; cpu++)
+		cpu_speed[cpu] = 1;
 
 	ld_processes.path = (char **)malloc(sizeof(char *) * num_processes);
 	ld_processes.start_time = (unsigned long *)malloc(sizeof(unsigned long) * num_processes);
@@ -209,57 +520,268 @@ static void read_config(const char *path)
 
 #ifdef MLQ_SCHED
 	ld_processes.prio = (unsigned long *)malloc(sizeof(unsigned long) * num_processes);
+	ld_processes.deadline = (unsigned long *)malloc(sizeof(unsigned long) * num_processes);
+	ld_processes.affinity = (unsigned long *)malloc(sizeof(unsigned long) * num_processes);
+	ld_processes.tickets = (unsigned long *)malloc(sizeof(unsigned long) * num_processes);
+	ld_processes.group = malloc(sizeof(*ld_processes.group) * num_processes);
+	ld_processes.group_id = (int *)malloc(sizeof(int) * num_processes);
 #endif
 	int i;
 	// printf("Number of processes: %d", num_processes);
 	for (i = 0; i < num_processes; i++)
 	{
-		ld_processes.path[i] = (char *)malloc(sizeof(char) * 100);
+		char proc[100];
+
+		/* Room for the directory and the longest name sscanf() takes */
+		ld_processes.path[i] = (char *)malloc(sizeof("input/proc/") + sizeof(proc));
 		ld_processes.path[i][0] = '\0';
 		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
 #ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
+		char line[256];
+		int n = 0;
 
-		// TODO: tự thêm
-		// printf("\n __ld_proc.p[i]: %lu", ld_processes.prio[i]);
-		// printf("\n __time.p[i]: %lu", ld_processes.start_time[i]);
-		// printf()
-		// TODO: END
+		/* Skip blank lines between process lines */
+		do
+			line[0] = '\0';
+		while (fgets(line, sizeof(line), file) != NULL &&
+		       strspn(line, " \t\r\n") == strlen(line));
+		sscanf(line, "%lu %99s %lu%n", &ld_processes.start_time[i], proc,
+		       &ld_processes.prio[i], &n);
+		read_proc_opts(line + n, i);
 #else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+		fscanf(file, "%lu %99s\n", &ld_processes.start_time[i], proc);
 #endif
 		strcat(ld_processes.path[i], proc);
 	}
+#ifdef MLQ_SCHED
+	read_directives(file);
+	for (i = 0; i < num_processes; i++)
+	{
+		ld_processes.group_id[i] = 0;
+		if (ld_processes.group[i][0] == '\0')
+			continue;
+		ld_processes.group_id[i] = sched_find_group(ld_processes.group[i]);
+		if (ld_processes.group_id[i] == 0)
+			printf("Unknown group %s, ignored\n", ld_processes.group[i]);
+	}
+#endif
+	fclose(file);
+}
+
+/* Print the share of busy, memory and idle slots of every CPU over the
+ * whole run, and write the timelines to [path] as CSV if it is set */
+static void report_utilization(const char *path)
+{
+	uint64_t end = 0, total[3] = {0, 0, 0}, t;
+	int i;
+
+	for (i = 0; i < num_cpus; i++)
+		if (timelines[i].len > end)
+			end = timelines[i].len;
+	if (end == 0)
+		return;
+	for (i = 0; i < num_cpus; i++)
+	{
+		uint64_t cnt[3] = {0, 0, 0};
+
+		for (t = 0; t < timelines[i].len; t++)
+			cnt[timelines[i].slot[t]]++;
+		cnt[SLOT_IDLE] += end - timelines[i].len;
+		printf("CPU %d utilization: busy %lu (%.1f%%), memory %lu (%.1f%%), idle %lu (%.1f%%) of %lu slots\n",
+		       i, cnt[SLOT_BUSY], 100.0 * cnt[SLOT_BUSY] / end,
+		       cnt[SLOT_MEM], 100.0 * cnt[SLOT_MEM] / end,
+		       cnt[SLOT_IDLE], 100.0 * cnt[SLOT_IDLE] / end, end);
+		total[SLOT_IDLE] += cnt[SLOT_IDLE];
+		total[SLOT_BUSY] += cnt[SLOT_BUSY];
+		total[SLOT_MEM] += cnt[SLOT_MEM];
+	}
+	printf("Utilization: %.1f%% over %d CPUs (busy %.1f%%, memory %.1f%%)\n",
+	       100.0 * (total[SLOT_BUSY] + total[SLOT_MEM]) / (end * num_cpus),
+	       num_cpus, 100.0 * total[SLOT_BUSY] / (end * num_cpus),
+	       100.0 * total[SLOT_MEM] / (end * num_cpus));
+
+	if (path)
+	{
+		static const char *name[] = {"idle", "busy", "mem"};
+		FILE *file = fopen(path, "w");
+
+		if (file == NULL)
+		{
+			printf("Cannot write utilization to %s\n", path);
+			return;
+		}
+		fprintf(file, "slot");
+		for (i = 0; i < num_cpus; i++)
+			fprintf(file, ",cpu%d", i);
+		fprintf(file, "\n");
+		for (t = 0; t < end; t++)
+		{
+			fprintf(file, "%lu", t);
+			for (i = 0; i < num_cpus; i++)
+				fprintf(file, ",%s", name[t < timelines[i].len ?
+							 timelines[i].slot[t] : SLOT_IDLE]);
+			fprintf(file, "\n");
+		}
+		fclose(file);
+	}
+}
+
+static void usage(void)
+{
+	printf("Usage: os [options] [path to configure file]\n");
+	printf("  -s policy   scheduling policy: mlq (default), mlfq, cfs, stride\n");
+	printf("  -a slots    MLQ aging, raise a waiting process one level every [slots]\n");
+	printf("  -m slots    idle slots before a CPU steals from a peer (default %d)\n",
+	       SCHED_MIGRATION_DELAY);
+	printf("  -q min:max  adaptive time quantum per process, within [min, max] slots\n");
+	printf("  -b slots    MLFQ boost period (default %d, 0 disables)\n",
+	       MLFQ_BOOST_PERIOD);
+	printf("  -p          preempt a lower priority process when a process arrives\n");
+	printf("  -t file     write a binary trace of the scheduler events, see trace-gantt\n");
+	printf("  -o file     write the per-process metrics as CSV\n");
+	printf("  -u file     write the busy/memory/idle timeline of every CPU as CSV\n");
+	printf("  -f          fast-forward through the slots every CPU is idle in\n");
+	printf("  -k slots    synchronize the CPUs every [slots] slots only, clocks may\n");
+	printf("              then be up to [slots] - 1 apart (default 1, lockstep)\n");
+	printf("  -d          run the CPUs, the loader and the timer in one thread, with a\n");
+	printf("              deterministic output\n");
+	printf("  -R file     replay the schedule of a trace written with -t, in one thread\n");
+	printf("  -l list     output categories to print, comma separated among time,\n");
+	printf("              sched, mem and dump (default all)\n");
+	printf("  -M file     write the memory operations to a binary trace instead of\n");
+	printf("              printing the memory dumps, see memtrace-dump\n");
 }
 
 int main(int argc, char *argv[])
 {
+	int opt;
+	const char *trace_path = NULL;
+	const char *metrics_path = NULL;
+	const char *util_path = NULL;
+	const char *replay_path = NULL;
+	const char *memtrace_path = NULL;
+
+	while ((opt = getopt(argc, argv, "s:a:m:q:b:pt:o:u:fk:dR:l:M:")) != -1)
+	{
+		switch (opt)
+		{
+		case 's':
+			if (sched_set_policy(optarg) != 0)
+			{
+				printf("Unknown scheduling policy %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'a':
+			sched_set_aging(atoi(optarg));
+			break;
+		case 'm':
+			sched_set_migration_delay(atoi(optarg));
+			break;
+		case 'q':
+		{
+			int min, max;
+
+			if (sscanf(optarg, "%d:%d", &min, &max) != 2 ||
+			    min < 1 || max < min)
+			{
+				printf("Invalid quantum bounds %s\n", optarg);
+				return 1;
+			}
+			sched_set_quantum(min, max);
+			break;
+		}
+		case 'b':
+			sched_set_boost(atoi(optarg));
+			break;
+		case 'p':
+			sched_set_preempt(1);
+			break;
+		case 't':
+			trace_path = optarg;
+			break;
+		case 'o':
+			metrics_path = optarg;
+			break;
+		case 'u':
+			util_path = optarg;
+			break;
+		case 'f':
+			fast_forward = 1;
+			break;
+		case 'k':
+			if (atoi(optarg) < 1)
+			{
+				printf("Invalid synchronization quantum %s\n", optarg);
+				return 1;
+			}
+			set_sync_quantum(atoi(optarg));
+			break;
+		case 'd':
+			serial = 1;
+			break;
+		case 'R':
+			replay_path = optarg;
+			break;
+		case 'l':
+			if (log_select(optarg) != 0)
+			{
+				printf("Unknown output category in %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'M':
+#ifdef MM_PAGING
+			memtrace_path = optarg;
+			break;
+#else
+			printf("Memory traces need MM_PAGING\n");
+			return 1;
+#endif
+		default:
+			usage();
+			return 1;
+		}
+	}
+
 	/* Read config */
-	if (argc != 2)
+	if (optind != argc - 1)
 	{
-		printf("Usage: os [path to configure file]\n");
+		usage();
 		return 1;
 	}
 	char path[100];
 	path[0] = '\0';
 	strcat(path, "input/");
-	strcat(path, argv[1]);
+	strcat(path, argv[optind]);
 	read_config(path);
+	if (trace_path && trace_init(trace_path, num_cpus) != 0)
+	{
+		printf("Cannot open trace file %s\n", trace_path);
+		return 1;
+	}
 
 	pthread_t *cpu = (pthread_t *)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args *args =
 		(struct cpu_args *)malloc(sizeof(struct cpu_args) * num_cpus);
 	pthread_t ld;
+	timelines = calloc(num_cpus, sizeof(struct cpu_timeline));
 
-	/* Init timer */
+	/* Init timer, the single-threaded engines move the time themselves */
 	int i;
-	for (i = 0; i < num_cpus; i++)
+	struct timer_id_t *ld_event = NULL;
+	if (serial || replay_path)
+		set_timer_wall_clock(0);
+	else
 	{
-		args[i].timer_id = attach_event();
-		args[i].id = i;
+		for (i = 0; i < num_cpus; i++)
+		{
+			args[i].timer_id = attach_event();
+			args[i].id = i;
+		}
+		ld_event = attach_event();
 	}
-	struct timer_id_t *ld_event = attach_event();
+	log_init();
 	start_timer(); // ! TẠI ĐÂY, TRONG HÀM start_time() CÓ TẠO THÊM (pthread_create) timer_routine:
 				  // ! timer_routine: nơi in ra "Time slot: ..."
 
@@ -272,6 +794,12 @@ int main(int argc, char *argv[])
 
 	/* Create MEM RAM */
 	init_memphy(&mram, memramsz, rdmflag);
+	if (memtrace_path && memtrace_init(memtrace_path, &mram) != 0)
+	{
+		log_finish();
+		printf("Cannot open memory trace file %s\n", memtrace_path);
+		return 1;
+	}
 
 	/* Create all MEM SWAP */
 	int sit;
@@ -289,31 +817,71 @@ int main(int argc, char *argv[])
 #endif
 
 	/* Init scheduler */
-	init_scheduler();
+	init_scheduler(num_cpus);
+	for (i = 0; i < num_cpus; i++)
+		sched_set_cpu_speed(i, cpu_speed[i]);
+#ifdef MM_PAGING
+	sched_set_swap(&mram);
+#endif
 
 	/* Run CPU and loader */
+	if (replay_path)
+	{
 #ifdef MM_PAGING
-	pthread_create(&ld, NULL, ld_routine, (void *)mm_ld_args);
+		if (run_replay(replay_path, mm_ld_args) != 0)
 #else
-	pthread_create(&ld, NULL, ld_routine, (void *)ld_event);
+		if (run_replay(replay_path, NULL) != 0)
 #endif
-
-for (i = 0; i < num_cpus; i++)
+		{
+			log_finish();
+			memtrace_finish();
+			return 1;
+		}
+	}
+	else if (serial)
 	{
-		pthread_create(&cpu[i], NULL,
-					   cpu_routine, (void *)&args[i]);
+#ifdef MM_PAGING
+		run_serial(mm_ld_args);
+#else
+		run_serial(NULL);
+#endif
 	}
-	/* Wait for CPU and loader finishing */
-	// chờ các cpu hoàn thành
-	for (i = 0; i < num_cpus; i++)
+	else
 	{
-		pthread_join(cpu[i], NULL);
+#ifdef MM_PAGING
+		pthread_create(&ld, NULL, ld_routine, (void *)mm_ld_args);
+#else
+		pthread_create(&ld, NULL, ld_routine, (void *)ld_event);
+#endif
+		for (i = 0; i < num_cpus; i++)
+		{
+			pthread_create(&cpu[i], NULL,
+						   cpu_routine, (void *)&args[i]);
+		}
+		/* Wait for CPU and loader finishing */
+		// chờ các cpu hoàn thành
+		for (i = 0; i < num_cpus; i++)
+		{
+			pthread_join(cpu[i], NULL);
+		}
+		// chờ luồng ld_routine hoàn thành
+		pthread_join(ld, NULL);
 	}
-	// chờ luồng ld_routine hoàn thành
-	pthread_join(ld, NULL);
 
-	/* Stop timer */
+	/* Stop timer, the reports below are printed directly */
+	log_finish();
 	stop_timer();
 
+	if (metrics_path && sched_write_metrics(metrics_path) != 0)
+		printf("Cannot write metrics to %s\n", metrics_path);
+	finish_scheduler();
+	trace_finish();
+	memtrace_finish();
+	report_utilization(util_path);
+	for (i = 0; i < num_cpus; i++)
+		free(timelines[i].slot);
+	free(timelines);
+	free(cpu_speed);
+
 	return 0;
 }
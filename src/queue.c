@@ -2,6 +2,20 @@
 #include <stdlib.h>
 #include "queue.h"
 
+void init_queue(struct queue_t *q)
+{
+        q->proc = NULL;
+        q->head = 0;
+        q->size = 0;
+        q->capacity = 0;
+}
+
+void free_queue(struct queue_t *q)
+{
+        free(q->proc);
+        init_queue(q);
+}
+
 int empty(struct queue_t *q)
 {
         if (q == NULL)
@@ -9,32 +23,218 @@ int empty(struct queue_t *q)
         return (q->size == 0);
 }
 
+/* Double the ring and unwrap it so that the first process is at index 0 */
+static void grow_queue(struct queue_t *q)
+{
+        int capacity = q->capacity ? q->capacity * 2 : QUEUE_INIT_SIZE;
+        struct pcb_t **proc = malloc(sizeof(struct pcb_t *) * capacity);
+        int i;
+
+        if (proc == NULL)
+        {
+                printf("Cannot grow queue to %d processes\n", capacity);
+                exit(1);
+        }
+        for (i = 0; i < q->size; i++)
+                proc[i] = q->proc[(q->head + i) % q->capacity];
+        free(q->proc);
+        q->proc = proc;
+        q->head = 0;
+        q->capacity = capacity;
+}
+
 void enqueue(struct queue_t *q, struct pcb_t *proc)
 {
-        /* TODO: put a new process to queue [q] */
-        // hình như là push proc vào q là xong, vì mỗi queue_t q là một con trỏ kiểu proc
-        // trong queue q thì có nhiều proc (một mảng), push proc(para) vào ô cuối cùng trong mảng
-        // if (q == NULL || proc == NULL) return;
-        if (q->size >= MAX_QUEUE_SIZE) return;
-        if (proc == NULL) return;
-        if (q == NULL) return;
-        q->proc[q->size++] = proc;
+        if (q == NULL || proc == NULL) return;
+        if (q->size == q->capacity)
+                grow_queue(q);
+        q->proc[(q->head + q->size) % q->capacity] = proc;
+        q->size++;
 }
 
 struct pcb_t *dequeue(struct queue_t *q)
 {
-        /* TODO: return a pcb whose prioprity is the highest
-         * in the queue [q] and remember to remove it from q
-         * */
-        // Do khi enqueue vào lộn xộn, nên khi lấy ra cần kiểm tra prio nào ưu tiên hơn sẽ lấy ra trước
+        struct pcb_t *proc;
+
         if (empty(q)) return NULL;
 
-        struct pcb_t *proc = q->proc[0];
-        for (int i = 0; i < q->size - 1; i++)
+        proc = q->proc[q->head];
+        q->proc[q->head] = NULL;
+        q->head = (q->head + 1) % q->capacity;
+        q->size--;
+        return proc;
+}
+
+/*
+ * dequeue_proc - remove the given process from queue [q]
+ * Return the process if it was found, otherwise NULL.
+ */
+struct pcb_t *dequeue_proc(struct queue_t *q, struct pcb_t *proc)
+{
+        int i, j;
+
+        if (empty(q) || proc == NULL) return NULL;
+
+        for (i = 0; i < q->size; i++)
         {
-                q->proc[i] = q->proc[i + 1];
+                if (q->proc[(q->head + i) % q->capacity] != proc)
+                        continue;
+                for (j = i; j < q->size - 1; j++)
+                        q->proc[(q->head + j) % q->capacity] =
+                                q->proc[(q->head + j + 1) % q->capacity];
+                q->proc[(q->head + q->size - 1) % q->capacity] = NULL;
+                q->size--;
+                return proc;
+        }
+        return NULL;
+}
+
+void init_heap(struct heap_t *h, int (*before)(struct pcb_t *, struct pcb_t *))
+{
+        h->proc = NULL;
+        h->size = 0;
+        h->capacity = 0;
+        h->before = before;
+}
+
+void free_heap(struct heap_t *h)
+{
+        free(h->proc);
+        h->proc = NULL;
+        h->size = h->capacity = 0;
+}
+
+static void heap_swap(struct heap_t *h, int i, int j)
+{
+        struct pcb_t *tmp = h->proc[i];
+
+        h->proc[i] = h->proc[j];
+        h->proc[j] = tmp;
+}
+
+static void heap_sift_up(struct heap_t *h, int i)
+{
+        while (i > 0 && h->before(h->proc[i], h->proc[(i - 1) / 2]))
+        {
+                heap_swap(h, i, (i - 1) / 2);
+                i = (i - 1) / 2;
+        }
+}
+
+static void heap_sift_down(struct heap_t *h, int i)
+{
+        while (1)
+        {
+                int l = 2 * i + 1, r = l + 1, first = i;
+
+                if (l < h->size && h->before(h->proc[l], h->proc[first]))
+                        first = l;
+                if (r < h->size && h->before(h->proc[r], h->proc[first]))
+                        first = r;
+                if (first == i)
+                        break;
+                heap_swap(h, i, first);
+                i = first;
+        }
+}
+
+void heap_push(struct heap_t *h, struct pcb_t *proc)
+{
+        int i;
+
+        if (proc == NULL) return;
+        if (h->size == h->capacity)
+        {
+                int capacity = h->capacity ? h->capacity * 2 : QUEUE_INIT_SIZE;
+                struct pcb_t **arr = realloc(h->proc, sizeof(struct pcb_t *) * capacity);
+
+                if (arr == NULL)
+                {
+                        printf("Cannot grow heap to %d processes\n", capacity);
+                        exit(1);
+                }
+                h->proc = arr;
+                h->capacity = capacity;
+        }
+
+        i = h->size++;
+        h->proc[i] = proc;
+        heap_sift_up(h, i);
+}
+
+struct pcb_t *heap_pop(struct heap_t *h)
+{
+        return heap_remove(h, 0);
+}
+
+struct pcb_t *heap_remove(struct heap_t *h, int i)
+{
+        struct pcb_t *proc;
+
+        if (i < 0 || i >= h->size) return NULL;
+
+        proc = h->proc[i];
+        h->proc[i] = h->proc[--h->size];
+        if (i < h->size)
+        {
+                /* The moved process may belong above or below slot i */
+                heap_sift_up(h, i);
+                heap_sift_down(h, i);
         }
-        q->proc[q->size - 1] = NULL;
-        q->size--;
         return proc;
 }
+
+struct pcb_t *heap_top(struct heap_t *h)
+{
+        return h->size ? h->proc[0] : NULL;
+}
+
+void init_spmc_queue(struct spmc_queue_t *q, unsigned long capacity)
+{
+        q->proc = calloc(capacity, sizeof(struct pcb_t *));
+        q->mask = capacity - 1;
+        q->head = 0;
+        q->tail = 0;
+}
+
+void free_spmc_queue(struct spmc_queue_t *q)
+{
+        free(q->proc);
+        q->proc = NULL;
+}
+
+int spmc_push(struct spmc_queue_t *q, struct pcb_t *proc)
+{
+        unsigned long tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        unsigned long head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+        if (tail - head > q->mask)
+                return -1;
+
+        __atomic_store_n(&q->proc[tail & q->mask], proc, __ATOMIC_RELAXED);
+        /* Publish the slot before the new tail becomes visible */
+        __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+        return 0;
+}
+
+struct pcb_t *spmc_pop(struct spmc_queue_t *q)
+{
+        unsigned long head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+        while (1)
+        {
+                unsigned long tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+                struct pcb_t *proc;
+
+                if (head == tail)
+                        return NULL;
+
+                /* The slot cannot be reused by the producer until head
+                 * moves past it, so a successful CAS validates the read */
+                proc = __atomic_load_n(&q->proc[head & q->mask], __ATOMIC_RELAXED);
+                if (__atomic_compare_exchange_n(&q->head, &head, head + 1, 0,
+                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                        return proc;
+                /* head was reloaded by the failed CAS, retry */
+        }
+}
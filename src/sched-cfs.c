@@ -0,0 +1,156 @@
+/*
+ * Completely fair scheduling policy
+ * Runnable processes are kept in a red-black tree ordered by their
+ * weighted virtual runtime, the leftmost one runs next. The weight comes
+ * from pcb_t->prio mapped onto the 40 nice levels of the Linux CFS.
+ */
+
+#include "sched-class.h"
+#include <stdio.h>
+
+#define NICE_0_LOAD	1024
+/* vruntime is kept in 1/CFS_VRUNTIME_SCALE slot units */
+#define CFS_VRUNTIME_SCALE 1024
+
+/* Weight of nice -20 .. 19, each level is ~10% of CPU share apart */
+static const int prio_to_weight[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	 9548,  7620,  6100,  4904,  3906,
+	 3121,  2501,  1991,  1586,  1277,
+	 1024,   820,   655,   526,   423,
+	  335,   272,   215,   172,   137,
+	  110,    87,    70,    56,    45,
+	   36,    29,    23,    18,    15,
+};
+
+static int cfs_weight(struct pcb_t *proc)
+{
+	int prio = proc->prio < MAX_PRIO ? proc->prio : MAX_PRIO - 1;
+
+	return prio_to_weight[prio * 40 / MAX_PRIO];
+}
+
+static int entity_before(struct pcb_t *a, struct pcb_t *b)
+{
+	if (a->vruntime != b->vruntime)
+		return (int64_t)(a->vruntime - b->vruntime) < 0;
+	return a->pid < b->pid;
+}
+
+static void update_min_vruntime(struct cfs_rq *cfs, uint64_t vruntime)
+{
+	if ((int64_t)(vruntime - cfs->min_vruntime) > 0)
+		cfs->min_vruntime = vruntime;
+}
+
+static void cfs_init_rq(struct sched_rq *rq)
+{
+	rq->cfs.tasks_timeline = RB_ROOT;
+	rq->cfs.leftmost = NULL;
+	rq->cfs.min_vruntime = 0;
+}
+
+static void cfs_free_rq(struct sched_rq *rq)
+{
+}
+
+static void cfs_enqueue(struct sched_rq *rq, struct pcb_t *proc, int new)
+{
+	struct cfs_rq *cfs = &rq->cfs;
+	struct rb_node **link = &cfs->tasks_timeline.rb_node;
+	struct rb_node *parent = NULL;
+	int leftmost = 1;
+
+	/* A new process starts at the queue floor instead of vruntime 0,
+	 * otherwise it would monopolize the CPU until it catches up */
+	if (new && (int64_t)(proc->vruntime - cfs->min_vruntime) < 0)
+		proc->vruntime = cfs->min_vruntime;
+
+	while (*link)
+	{
+		parent = *link;
+		if (entity_before(proc, rb_entry(parent, struct pcb_t, run_node)))
+			link = &parent->rb_left;
+		else
+		{
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	rb_link_node(&proc->run_node, parent, link);
+	rb_insert_color(&proc->run_node, &cfs->tasks_timeline);
+	if (leftmost)
+		cfs->leftmost = &proc->run_node;
+}
+
+static struct pcb_t *cfs_pick_next(struct sched_rq *rq)
+{
+	struct cfs_rq *cfs = &rq->cfs;
+	struct pcb_t *proc;
+
+	if (cfs->leftmost == NULL)
+		return NULL;
+
+	proc = rb_entry(cfs->leftmost, struct pcb_t, run_node);
+	cfs->leftmost = rb_next(cfs->leftmost);
+	rb_erase(&proc->run_node, &cfs->tasks_timeline);
+	update_min_vruntime(cfs, proc->vruntime);
+	return proc;
+}
+
+/* Leftmost process allowed on [cpu], in vruntime order */
+static struct pcb_t *cfs_steal(struct sched_rq *rq, int cpu)
+{
+	struct cfs_rq *cfs = &rq->cfs;
+	struct rb_node *node;
+
+	for (node = cfs->leftmost; node != NULL; node = rb_next(node))
+	{
+		struct pcb_t *proc = rb_entry(node, struct pcb_t, run_node);
+
+		if (!proc_allowed(proc, cpu))
+			continue;
+		if (node == cfs->leftmost)
+			cfs->leftmost = rb_next(node);
+		rb_erase(node, &cfs->tasks_timeline);
+		return proc;
+	}
+	return NULL;
+}
+
+static void cfs_put_prev(struct sched_rq *rq, struct pcb_t *proc, int ran)
+{
+	proc->vruntime += (uint64_t)ran * CFS_VRUNTIME_SCALE * NICE_0_LOAD /
+			  cfs_weight(proc);
+}
+
+/* Keep the lag of a migrated process relative to its new queue */
+static void cfs_migrate(struct sched_rq *src, struct sched_rq *dst,
+			struct pcb_t *proc)
+{
+	proc->vruntime = proc->vruntime - src->cfs.min_vruntime +
+			 dst->cfs.min_vruntime;
+}
+
+static void cfs_report(struct sched_rq *rqs, int nr)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < nr; cpu++)
+		printf("CFS CPU %d: min_vruntime %.2f\n", cpu,
+		       (double)rqs[cpu].cfs.min_vruntime / CFS_VRUNTIME_SCALE);
+}
+
+const struct sched_class cfs_sched_class = {
+	.name		= "cfs",
+	.init_rq	= cfs_init_rq,
+	.free_rq	= cfs_free_rq,
+	.enqueue	= cfs_enqueue,
+	.pick_next	= cfs_pick_next,
+	.steal		= cfs_steal,
+	.put_prev	= cfs_put_prev,
+	.migrate	= cfs_migrate,
+	.report		= cfs_report,
+};
@@ -0,0 +1,90 @@
+/*
+ * Earliest deadline first scheduling class
+ * Processes loaded with a deadline are kept in a per-CPU min-heap on
+ * their absolute deadline and always run ahead of the policy selected
+ * with -s. Preemption on arrival is driven by add_proc() in the core.
+ */
+
+#include "sched-class.h"
+#include <stdio.h>
+
+static int deadline_before(struct pcb_t *a, struct pcb_t *b)
+{
+	if (a->deadline != b->deadline)
+		return a->deadline < b->deadline;
+	return a->pid < b->pid;
+}
+
+static void edf_init_rq(struct sched_rq *rq)
+{
+	init_heap(&rq->edf.heap, deadline_before);
+}
+
+static void edf_free_rq(struct sched_rq *rq)
+{
+	free_heap(&rq->edf.heap);
+}
+
+static void edf_enqueue(struct sched_rq *rq, struct pcb_t *proc, int new)
+{
+	heap_push(&rq->edf.heap, proc);
+}
+
+static struct pcb_t *edf_pick_next(struct sched_rq *rq)
+{
+	return heap_pop(&rq->edf.heap);
+}
+
+/* Earliest deadline allowed on [cpu], the heap is scanned linearly */
+static struct pcb_t *edf_steal(struct sched_rq *rq, int cpu)
+{
+	struct heap_t *heap = &rq->edf.heap;
+	int i, first = -1;
+
+	for (i = 0; i < heap->size; i++)
+		if (proc_allowed(heap->proc[i], cpu) &&
+		    (first < 0 || deadline_before(heap->proc[i], heap->proc[first])))
+			first = i;
+	return heap_remove(heap, first);
+}
+
+static void edf_put_prev(struct sched_rq *rq, struct pcb_t *proc, int ran)
+{
+}
+
+static void edf_report(struct sched_rq *rqs, int nr)
+{
+	int met = 0, missed = 0;
+	int i;
+
+	for (i = 0; i < nr_proc_stats; i++)
+	{
+		struct proc_stat *st = &proc_stats[i];
+
+		if (st->deadline == 0)
+			continue;
+		if (met + missed == 0)
+			printf("EDF deadlines:\n");
+		if (st->finish <= st->deadline)
+			met++;
+		else
+			missed++;
+		printf("\tPID %2d: deadline %4lu finish %4lu lateness %+5ld %s\n",
+		       st->pid, st->deadline, st->finish,
+		       (long)(st->finish - st->deadline),
+		       st->finish <= st->deadline ? "met" : "MISSED");
+	}
+	if (met + missed)
+		printf("EDF: %d deadlines met, %d missed\n", met, missed);
+}
+
+const struct sched_class edf_sched_class = {
+	.name		= "edf",
+	.init_rq	= edf_init_rq,
+	.free_rq	= edf_free_rq,
+	.enqueue	= edf_enqueue,
+	.pick_next	= edf_pick_next,
+	.steal		= edf_steal,
+	.put_prev	= edf_put_prev,
+	.report		= edf_report,
+};
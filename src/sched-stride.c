@@ -0,0 +1,134 @@
+/*
+ * Stride scheduling policy (proportional share)
+ * Every process holds tickets, from the tickets= config column or derived
+ * from pcb_t->prio, and advances its pass by STRIDE1 / tickets for each
+ * slot it runs. The process with the smallest pass runs next, so over
+ * time the CPU share of each process converges to its share of tickets,
+ * deterministically, unlike lottery scheduling.
+ */
+
+#include "sched-class.h"
+#include <stdio.h>
+
+#define STRIDE1 (1 << 20)
+
+/* Without a tickets= column, prio 0 gets MAX_PRIO tickets, MAX_PRIO - 1 one */
+static int stride_tickets(struct pcb_t *proc)
+{
+	if (proc->tickets == 0)
+		proc->tickets = proc->prio < MAX_PRIO ? MAX_PRIO - proc->prio : 1;
+	else if (proc->tickets > STRIDE1)
+		proc->tickets = STRIDE1;
+	return proc->tickets;
+}
+
+static int pass_before(struct pcb_t *a, struct pcb_t *b)
+{
+	if (a->pass != b->pass)
+		return (int64_t)(a->pass - b->pass) < 0;
+	return a->pid < b->pid;
+}
+
+static void stride_init_rq(struct sched_rq *rq)
+{
+	init_heap(&rq->stride.heap, pass_before);
+	rq->stride.global_pass = 0;
+}
+
+static void stride_free_rq(struct sched_rq *rq)
+{
+	free_heap(&rq->stride.heap);
+}
+
+static void stride_enqueue(struct sched_rq *rq, struct pcb_t *proc, int new)
+{
+	/* A new process starts level with the queue, it gets no credit for
+	 * the time before it arrived */
+	if (new)
+	{
+		stride_tickets(proc);
+		proc->pass = rq->stride.global_pass;
+	}
+	heap_push(&rq->stride.heap, proc);
+}
+
+static void update_global_pass(struct stride_rq *stride, uint64_t pass)
+{
+	if ((int64_t)(pass - stride->global_pass) > 0)
+		stride->global_pass = pass;
+}
+
+static struct pcb_t *stride_pick_next(struct sched_rq *rq)
+{
+	struct pcb_t *proc = heap_pop(&rq->stride.heap);
+
+	if (proc != NULL)
+		update_global_pass(&rq->stride, proc->pass);
+	return proc;
+}
+
+static struct pcb_t *stride_steal(struct sched_rq *rq, int cpu)
+{
+	struct heap_t *heap = &rq->stride.heap;
+	int i, first = -1;
+
+	for (i = 0; i < heap->size; i++)
+		if (proc_allowed(heap->proc[i], cpu) &&
+		    (first < 0 || pass_before(heap->proc[i], heap->proc[first])))
+			first = i;
+	return heap_remove(heap, first);
+}
+
+static void stride_put_prev(struct sched_rq *rq, struct pcb_t *proc, int ran)
+{
+	proc->pass += (uint64_t)ran * (STRIDE1 / stride_tickets(proc));
+}
+
+/* Keep the lag of a migrated process relative to its new queue */
+static void stride_migrate(struct sched_rq *src, struct sched_rq *dst,
+			   struct pcb_t *proc)
+{
+	proc->pass = proc->pass - src->stride.global_pass +
+		     dst->stride.global_pass;
+}
+
+/*
+ * The requested share is the ticket share among all the processes of the
+ * run, the actual share is the part of its lifetime (arrival to finish)
+ * a process spent on a CPU, scaled to the CPUs of the run. Both match for
+ * processes that competed side by side for all of their life.
+ */
+static void stride_report(struct sched_rq *rqs, int nr)
+{
+	uint64_t tickets = 0;
+	int i;
+
+	for (i = 0; i < nr_proc_stats; i++)
+		tickets += proc_stats[i].tickets;
+	if (tickets == 0)
+		return;
+
+	printf("Stride shares:\n");
+	for (i = 0; i < nr_proc_stats; i++)
+	{
+		struct proc_stat *st = &proc_stats[i];
+		uint64_t alive = st->finish - st->arrival;
+
+		printf("\tPID %2d: %3d tickets, requested %5.1f%%, used %4lu of %4lu slots alive (%5.1f%%)\n",
+		       st->pid, st->tickets, 100.0 * st->tickets / tickets,
+		       st->runtime, alive,
+		       alive ? 100.0 * st->runtime / alive / nr : 0.0);
+	}
+}
+
+const struct sched_class stride_sched_class = {
+	.name		= "stride",
+	.init_rq	= stride_init_rq,
+	.free_rq	= stride_free_rq,
+	.enqueue	= stride_enqueue,
+	.pick_next	= stride_pick_next,
+	.steal		= stride_steal,
+	.put_prev	= stride_put_prev,
+	.migrate	= stride_migrate,
+	.report		= stride_report,
+};
@@ -1,209 +1,2057 @@
 #include "queue.h"
 #include "sched.h"
+#include "sched-class.h"
+#include "timer.h"
+#include "trace.h"
+#include "log.h"
+#ifdef MM_PAGING
+#include "mm.h"
+#endif
 #include <pthread.h>
 
-#include <stdlib.h>
-#include <stdio.h>
-static struct queue_t ready_queue; // nếu đã DEFINE MLQ thì không sử dụng biến này
-static struct queue_t run_queue;   // để vậy chứ không sử dụng
-static pthread_mutex_t queue_lock;
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef MLQ_SCHED
+static struct sched_rq *runqueues;
+static int nr_rqs;
+
+int sched_aging_slots = 0;
+int sched_migration_delay = SCHED_MIGRATION_DELAY;
+int sched_quantum_min, sched_quantum_max;
+int sched_mlfq_boost = MLFQ_BOOST_PERIOD;
+int sched_arrival_preempt;
+
+struct proc_stat *proc_stats;
+int nr_proc_stats;
+static int proc_stats_cap;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Policy selected at startup, MLQ by default */
+static const struct sched_class *sched_class = &mlq_sched_class;
+
+static const struct sched_class *sched_classes[] = {
+	&mlq_sched_class,
+	&mlfq_sched_class,
+	&cfs_sched_class,
+	&stride_sched_class,
+};
+
+/*
+ *  Loader-to-CPU admission queue
+ *  The loader is the only producer, any CPU asking for work pops from it
+ *  without taking a lock. When it is full add_proc() falls back to the
+ *  locked run queue of the least loaded CPU, nothing is dropped.
+ */
+#define LD_INBOX_SIZE 256
+static struct spmc_queue_t ld_inbox;
+
+/*
+ *  Parked CPUs
+ *  An idle CPU parks instead of polling its run queue every slot, the
+ *  timer counts it as done until it is unparked. Work arriving through
+ *  add_proc()/put_proc() unparks exactly one CPU. Parking stops once the
+ *  loader is done so that idle CPUs can notice it and exit.
+ */
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static int nr_parked;
+static int parking_closed;
+
+/* Bandwidth groups, see struct sched_group */
+static struct sched_group groups[SCHED_MAX_GROUPS];
+static int nr_groups;
+static int nr_throttled;	// Processes on the throttled lists
+
+#ifdef MM_PAGING
+/*
+ *  Medium-term swapper
+ *  While the free MEMRAM frames are below the low watermark, a process of
+ *  the lowest priority holding frames is suspended at its next dispatch
+ *  point:
+ *  all its resident pages are written to swap in one pass and it waits
+ *  on swapped_list. Suspended processes come back in order once the free
+ *  frames reach the high watermark. The loader holds new processes back
+ *  in the meantime, see sched_mem_pressure().
+ */
+static struct memphy_struct *swap_ram;
+static int swap_low, swap_high;		// Watermarks, in free frames
+static pthread_mutex_t swap_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct queue_t swapped_list;
+static int nr_swapped;			// Processes on swapped_list
+static int nr_resident[MAX_PRIO];	// Processes holding frames, by base_prio
+static unsigned long swap_out_cnt, swap_in_cnt, swap_out_pages;
+#endif
+
+/*
+ *  Replay of a scheduler trace, see sched_replay()
+ *  Each CPU follows the events of its own ring of the trace instead of
+ *  the policy. Processes waiting to run sit in a pool by pid rather than
+ *  on the run queues, the DISPATCH events take them out.
+ */
+struct replay_ring {
+	struct trace_event *ev;
+	int nr, cap;
+	int next;			// First event not replayed yet
+};
+
+static struct replay_ring *replay_rings;	// CPUs then the loader, NULL unless replaying
+static struct pcb_t **replay_pool;		// Waiting processes by pid
+static uint32_t replay_pool_cap;
+static int replay_nr_waiting;
+
+/* Whether any process waits in the inbox, a run queue or a group */
+static int work_queued(void)
+{
+	int cpu;
+
+	if (__atomic_load_n(&ld_inbox.head, __ATOMIC_RELAXED) !=
+	    __atomic_load_n(&ld_inbox.tail, __ATOMIC_RELAXED))
+		return 1;
+	/* Throttled processes come back at the end of their group period,
+	 * some CPU must keep polling to notice it */
+	if (__atomic_load_n(&nr_throttled, __ATOMIC_RELAXED))
+		return 1;
+#ifdef MM_PAGING
+	if (__atomic_load_n(&nr_swapped, __ATOMIC_RELAXED))
+		return 1;
+#endif
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+		if (__atomic_load_n(&runqueues[cpu].nr_running, __ATOMIC_RELAXED))
+			return 1;
+	return 0;
+}
+
+/* Whether any process waits in the replay pool for a CPU to dispatch it */
+static int replay_work_queued(void)
+{
+	int cpu;
+
+	if (replay_nr_waiting == 0)
+		return 0;
+	/* A trace cut short leaves processes no CPU dispatches */
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+		if (replay_rings[cpu].next < replay_rings[cpu].nr)
+			return 1;
+	return 0;
+}
+
+#else
+static struct queue_t ready_queue;
+static struct queue_t running_list;
+static pthread_mutex_t queue_lock;
+#endif
+
+int queue_empty(void)
+{
+#ifdef MLQ_SCHED
+	return replay_rings ? !replay_work_queued() : !work_queued();
+#else
+	return empty(&ready_queue);
+#endif
+}
+
+#ifdef MLQ_SCHED
+int sched_set_policy(const char *name)
+{
+	int i;
+
+	for (i = 0; i < sizeof(sched_classes) / sizeof(sched_classes[0]); i++)
+	{
+		if (!strcmp(sched_classes[i]->name, name))
+		{
+			sched_class = sched_classes[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void sched_set_aging(int slots)
+{
+	sched_aging_slots = slots;
+}
+
+void sched_set_migration_delay(int slots)
+{
+	sched_migration_delay = slots;
+}
+
+void sched_set_quantum(int min, int max)
+{
+	sched_quantum_min = min > 0 ? min : 1;
+	sched_quantum_max = max;
+}
+
+void sched_set_boost(int slots)
+{
+	sched_mlfq_boost = slots;
+}
+
+void sched_set_preempt(int on)
+{
+	sched_arrival_preempt = on;
+}
+#endif
+
+#ifdef MLQ_SCHED
+void sched_set_cpu_speed(int cpu, int speed)
+{
+	if (cpu >= 0 && cpu < nr_rqs && speed > 0)
+		runqueues[cpu].speed = speed;
+}
+
+/* Number of idle CPUs faster than [rq], they should take new work first */
+static int nr_faster_idle(struct sched_rq *rq)
+{
+	int cpu, nr = 0;
+
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+		if (runqueues[cpu].speed > rq->speed &&
+		    __atomic_load_n(&runqueues[cpu].idle, __ATOMIC_RELAXED))
+			nr++;
+	return nr;
+}
+
+/* Fastest idle CPU with nothing queued that is faster than [rq] and may
+ * run [proc], -1 if none. Lockless */
+static int faster_idle_cpu(struct sched_rq *rq, struct pcb_t *proc)
+{
+	int cpu, target = -1;
+
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+		if (runqueues[cpu].speed > (target < 0 ? rq->speed :
+					    runqueues[target].speed) &&
+		    proc_allowed(proc, cpu) &&
+		    __atomic_load_n(&runqueues[cpu].idle, __ATOMIC_RELAXED) &&
+		    !__atomic_load_n(&runqueues[cpu].nr_running, __ATOMIC_RELAXED))
+			target = cpu;
+	return target;
+}
+#endif
+
+void init_scheduler(int num_cpus)
+{
+#ifdef MLQ_SCHED
+	int cpu;
+
+	nr_rqs = num_cpus;
+	runqueues = malloc(sizeof(struct sched_rq) * nr_rqs);
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+	{
+		struct sched_rq *rq = &runqueues[cpu];
+
+		rq->cpu = cpu;
+		rq->speed = 1;
+		rq->busy_slots = 0;
+		init_queue(&rq->running_list);
+		rq->idle = 1;
+		rq->curr_deadline = EDF_NO_DEADLINE;
+		rq->need_resched = 0;
+		rq->curr_key = -1;
+		rq->parked = NULL;
+		rq->park_cnt = rq->parked_slots = rq->preempt_cnt = 0;
+		rq->nr_running = 0;
+		rq->dispatch_cnt = rq->steal_cnt = 0;
+		memset(rq->nr_prio, 0, sizeof(rq->nr_prio));
+		memset(rq->wait_cnt, 0, sizeof(rq->wait_cnt));
+		memset(rq->max_wait, 0, sizeof(rq->max_wait));
+		pthread_mutex_init(&rq->lock, NULL);
+		edf_sched_class.init_rq(rq);
+		sched_class->init_rq(rq);
+	}
+	init_spmc_queue(&ld_inbox, LD_INBOX_SIZE);
+#ifdef MM_PAGING
+	init_queue(&swapped_list);
+#endif
+#else
+	init_queue(&ready_queue);
+	init_queue(&running_list);
+	pthread_mutex_init(&queue_lock, NULL);
+#endif
+}
+
+#ifdef MLQ_SCHED
+static void report_migrations(void)
+{
+	unsigned long total = 0;
+	int i, moved = 0;
+
+	for (i = 0; i < nr_proc_stats; i++)
+	{
+		if (proc_stats[i].migrations == 0)
+			continue;
+		if (moved == 0)
+			printf("Migrations per process:\n");
+		printf("\tPID %2d: %lu migrations\n",
+		       proc_stats[i].pid, proc_stats[i].migrations);
+		total += proc_stats[i].migrations;
+		moved++;
+	}
+	printf("Migrations: %lu over %d of %d processes (steal after %d idle slots)\n",
+	       total, moved, nr_proc_stats, sched_migration_delay);
+}
+
+#ifdef MM_PAGING
+static void report_swap(void)
+{
+	if (swap_ram == NULL)
+		return;
+	printf("Swapper: watermarks %d/%d free frames, %lu processes swapped out (%lu pages), %lu swapped in\n",
+	       swap_low, swap_high, swap_out_cnt, swap_out_pages, swap_in_cnt);
+}
+#endif
+
+static void report_groups(void)
+{
+	int i;
+
+	for (i = 0; i < nr_groups; i++)
+	{
+		struct sched_group *g = &groups[i];
+
+		printf("Group %s: quota %d of %d slots, used %lu slots, throttled %lu times (%lu processes)\n",
+		       g->name, g->quota, g->period, g->total_usage,
+		       g->throttle_cnt, g->throttled_procs);
+	}
+}
+
+static void report_latency(void)
+{
+	uint64_t total = 0, max = 0;
+	unsigned long preempts = 0;
+	int i;
+
+	if (nr_proc_stats == 0)
+		return;
+	printf("Arrival to first run latency per process:\n");
+	for (i = 0; i < nr_proc_stats; i++)
+	{
+		struct proc_stat *st = &proc_stats[i];
+		uint64_t latency = st->first_run - st->arrival;
+
+		printf("\tPID %2d: PRIO %3d arrival %4lu first run %4lu latency %3lu\n",
+		       st->pid, st->prio, st->arrival, st->first_run, latency);
+		total += latency;
+		if (latency > max)
+			max = latency;
+	}
+	for (i = 0; i < nr_rqs; i++)
+		preempts += runqueues[i].preempt_cnt;
+	printf("Dispatch latency: avg %.2f, max %lu slots, %lu arrival preemptions\n",
+	       (double)total / nr_proc_stats, max, preempts);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Print mean, median and 99th percentile of [vals], sorting them */
+static void print_dist(const char *name, uint64_t *vals, int n)
+{
+	uint64_t sum = 0;
+	int i;
+
+	qsort(vals, n, sizeof(uint64_t), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += vals[i];
+	/* Nearest rank */
+	printf("  %s %7.1f %5lu %5lu", name, (double)sum / n,
+	       vals[(n - 1) / 2], vals[(n * 99 + 99) / 100 - 1]);
+}
+
+/*
+ *  report_metrics - turnaround (arrival to finish), waiting (slots queued
+ *  before each dispatch) and response (arrival to first dispatch) of every
+ *  finished process, then their distribution per priority level
+ */
+static void report_metrics(void)
+{
+	uint64_t *turnaround, *waiting, *response;
+	int i, prio;
+
+	if (nr_proc_stats == 0)
+		return;
+	printf("Process metrics (slots):\n");
+	printf("\t PID PRIO arrival first finish  run wait preempt turnaround response\n");
+	for (i = 0; i < nr_proc_stats; i++)
+	{
+		struct proc_stat *st = &proc_stats[i];
+
+		printf("\t%4d %4d %7lu %5lu %6lu %4lu %4lu %7lu %10lu %8lu\n",
+		       st->pid, st->prio, st->arrival, st->first_run, st->finish,
+		       st->runtime, st->wait, st->switches,
+		       st->finish - st->arrival, st->first_run - st->arrival);
+	}
+
+	turnaround = malloc(sizeof(uint64_t) * nr_proc_stats);
+	waiting = malloc(sizeof(uint64_t) * nr_proc_stats);
+	response = malloc(sizeof(uint64_t) * nr_proc_stats);
+	printf("Metrics per priority level (mean p50 p99):\n");
+	for (prio = 0; prio < MAX_PRIO; prio++)
+	{
+		int n = 0;
+
+		for (i = 0; i < nr_proc_stats; i++)
+		{
+			struct proc_stat *st = &proc_stats[i];
+
+			if (st->prio != prio)
+				continue;
+			turnaround[n] = st->finish - st->arrival;
+			waiting[n] = st->wait;
+			response[n] = st->first_run - st->arrival;
+			n++;
+		}
+		if (n == 0)
+			continue;
+		printf("\tPRIO %3d: %3d procs", prio, n);
+		print_dist("turnaround", turnaround, n);
+		print_dist("waiting", waiting, n);
+		print_dist("response", response, n);
+		printf("\n");
+	}
+	free(turnaround);
+	free(waiting);
+	free(response);
+}
+
+static void report_switches(void)
+{
+	unsigned long total = 0;
+	int i;
+
+	printf("Context switches per process:\n");
+	for (i = 0; i < nr_proc_stats; i++)
+	{
+		printf("\tPID %2d: %lu switches", proc_stats[i].pid,
+		       proc_stats[i].switches);
+		if (sched_quantum_max || sched_class->quantum)
+			printf(", quantum %d", proc_stats[i].quantum);
+		printf("\n");
+		total += proc_stats[i].switches;
+	}
+	if (sched_class->quantum)
+		printf("Context switches: %lu (%s quantum)\n", total,
+		       sched_class->name);
+	else if (sched_quantum_max)
+		printf("Context switches: %lu (adaptive quantum %d..%d)\n",
+		       total, sched_quantum_min, sched_quantum_max);
+	else
+		printf("Context switches: %lu (fixed quantum)\n", total);
+}
+#endif
+
+int sched_write_metrics(const char *path)
+{
+#ifdef MLQ_SCHED
+	FILE *file = fopen(path, "w");
+	int i;
+
+	if (file == NULL)
+		return -1;
+	fprintf(file, "pid,prio,arrival,first_run,finish,run,wait,preemptions,migrations,turnaround,response\n");
+	for (i = 0; i < nr_proc_stats; i++)
+	{
+		struct proc_stat *st = &proc_stats[i];
+
+		fprintf(file, "%u,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+			st->pid, st->prio, st->arrival, st->first_run, st->finish,
+			st->runtime, st->wait, st->switches, st->migrations,
+			st->finish - st->arrival, st->first_run - st->arrival);
+	}
+	fclose(file);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+void finish_scheduler(void)
+{
+#ifdef MLQ_SCHED
+	int cpu, prio;
+
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+	{
+		struct sched_rq *rq = &runqueues[cpu];
+
+		printf("CPU %d: speed %d, busy %lu slots, %lu picks, %lu steals, parked %lu times for %lu slots\n",
+		       cpu, rq->speed, rq->busy_slots, rq->dispatch_cnt,
+		       rq->steal_cnt, rq->park_cnt, rq->parked_slots);
+	}
+	printf("Max wait per priority level:\n");
+	for (prio = 0; prio < MAX_PRIO; prio++)
+	{
+		unsigned long cnt = 0;
+		uint64_t max_wait = 0;
+
+		for (cpu = 0; cpu < nr_rqs; cpu++)
+		{
+			if (runqueues[cpu].max_wait[prio] > max_wait)
+				max_wait = runqueues[cpu].max_wait[prio];
+			cnt += runqueues[cpu].wait_cnt[prio];
+		}
+		if (cnt)
+			printf("\tPRIO %3d: %lu slots over %lu dispatches\n",
+			       prio, max_wait, cnt);
+	}
+	report_groups();
+#ifdef MM_PAGING
+	report_swap();
+#endif
+	report_metrics();
+	report_latency();
+	report_migrations();
+	report_switches();
+	/* A replay bypasses the policy, it has nothing to report */
+	if (sched_class->report && replay_rings == NULL)
+		sched_class->report(runqueues, nr_rqs);
+	edf_sched_class.report(runqueues, nr_rqs);
+
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+	{
+		struct sched_rq *rq = &runqueues[cpu];
+
+		edf_sched_class.free_rq(rq);
+		sched_class->free_rq(rq);
+		free_queue(&rq->running_list);
+		pthread_mutex_destroy(&rq->lock);
+	}
+	if (replay_rings)
+	{
+		uint32_t pid;
+
+		/* Processes the trace leaves unfinished */
+		for (pid = 0; pid < replay_pool_cap; pid++)
+		{
+			if (replay_pool[pid] == NULL)
+				continue;
+#ifdef MM_PAGING
+			free_pcb_memph(replay_pool[pid]);
+#endif
+			free(replay_pool[pid]);
+		}
+		for (cpu = 0; cpu <= nr_rqs; cpu++)
+			free(replay_rings[cpu].ev);
+		free(replay_rings);
+		free(replay_pool);
+		replay_rings = NULL;
+		replay_pool = NULL;
+		replay_pool_cap = replay_nr_waiting = 0;
+	}
+	free(runqueues);
+	runqueues = NULL;
+	nr_rqs = 0;
+	nr_parked = parking_closed = 0;
+	for (cpu = 0; cpu < nr_groups; cpu++)
+		free_queue(&groups[cpu].throttled_list);
+#ifdef MM_PAGING
+	free_queue(&swapped_list);
+	swap_ram = NULL;
+	nr_swapped = 0;
+	memset(nr_resident, 0, sizeof(nr_resident));
+	swap_out_cnt = swap_in_cnt = swap_out_pages = 0;
+#endif
+	free_spmc_queue(&ld_inbox);
+	free(proc_stats);
+	proc_stats = NULL;
+	nr_proc_stats = proc_stats_cap = 0;
+#else
+	free_queue(&ready_queue);
+	free_queue(&running_list);
+	pthread_mutex_destroy(&queue_lock);
+#endif
+}
+
+#ifdef MLQ_SCHED
+/*
+ *  Stateful design for routine calling
+ *  based on the priority and our MLQ policy
+ *  We implement stateful here using transition technique
+ *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
+ *
+ *  Each level prio may be dispatched slot[prio] = MAX_PRIO - prio times per
+ *  epoch. Once every non-empty level has spent its budget a new epoch starts
+ *  and all budgets are refilled; the refill is lazy (see slot_epoch) so it
+ *  costs the same whatever the number of levels.
+ */
+
+static void mlq_init_rq(struct sched_rq *rq)
+{
+	struct mlq_rq *mlq = &rq->mlq;
+	int i;
+
+	for (i = 0; i < MAX_PRIO; i++)
+	{
+		init_queue(&mlq->ready_queue[i]);
+		mlq->slot[i] = MAX_PRIO - i;
+		mlq->slot_epoch[i] = 0;
+	}
+	for (i = 0; i < BITS_TO_LONGS(MAX_PRIO); i++)
+	{
+		mlq->ready_map[i] = 0;
+		mlq->expired_map[i] = 0;
+	}
+	mlq->epoch = 0;
+	mlq->last_aging = 0;
+	mlq->dispatch_cost = mlq->epoch_cnt = mlq->aging_cnt = 0;
+}
+
+static void mlq_free_rq(struct sched_rq *rq)
+{
+	int i;
+
+	for (i = 0; i < MAX_PRIO; i++)
+		free_queue(&rq->mlq.ready_queue[i]);
+}
+
+/* mlq_find_prio - highest priority level eligible for dispatch, -1 if none
+ * @cost: incremented by the number of bitmap words examined
+ */
+static int mlq_find_prio(struct mlq_rq *mlq, unsigned long *cost)
+{
+	int w, refilled = 0;
+
+	while (1)
+	{
+		int nonempty = 0;
+
+		for (w = 0; w < BITS_TO_LONGS(MAX_PRIO); w++)
+		{
+			unsigned long bits = mlq->ready_map[w] & ~mlq->expired_map[w];
+
+			(*cost)++;
+			if (bits)
+				return w * BITS_PER_LONG + __ffs(bits);
+			if (mlq->ready_map[w])
+				nonempty = 1;
+		}
+
+		if (!nonempty || refilled)
+			return -1;
+
+		/* All non-empty levels are expired, start a new epoch */
+		for (w = 0; w < BITS_TO_LONGS(MAX_PRIO); w++)
+			mlq->expired_map[w] = 0;
+		mlq->epoch++;
+		mlq->epoch_cnt++;
+		refilled = 1;
+	}
+}
+
+static void mlq_enqueue(struct sched_rq *rq, struct pcb_t *proc, int new)
+{
+	struct mlq_rq *mlq = &rq->mlq;
+
+	proc->mlq_ready_queue = mlq->ready_queue;
+	proc->aged_at = sync_time();
+	enqueue(&mlq->ready_queue[proc->prio], proc);
+	set_bit(proc->prio, mlq->ready_map);
+}
+
+/*
+ *  mlq_age - raise by one level every process that waited sched_aging_slots
+ *  in its current level. Each level queue is ordered by aged_at, since
+ *  processes are only appended with aged_at = sync_time(), so only the
+ *  heads need to be looked at. Levels are walked upward from prio 1, a promoted
+ *  process lands in an already visited level and moves once per pass.
+ */
+static void mlq_age(struct mlq_rq *mlq, uint64_t now)
+{
+	int w;
+
+	for (w = 0; w < BITS_TO_LONGS(MAX_PRIO); w++)
+	{
+		unsigned long bits = mlq->ready_map[w];
+
+		while (bits)
+		{
+			int prio = w * BITS_PER_LONG + __ffs(bits);
+			struct queue_t *q = &mlq->ready_queue[prio];
+
+			bits &= bits - 1;
+			if (prio == 0)
+				continue;
+
+			while (!empty(q) &&
+			       now - q->proc[q->head]->aged_at >= sched_aging_slots)
+			{
+				struct pcb_t *proc = dequeue(q);
+
+				proc->prio = prio - 1;
+				proc->aged_at = sync_time();
+				enqueue(&mlq->ready_queue[prio - 1], proc);
+				set_bit(prio - 1, mlq->ready_map);
+				mlq->aging_cnt++;
+			}
+			if (empty(q))
+				clear_bit(prio, mlq->ready_map);
+		}
+	}
+}
+
+static struct pcb_t *mlq_pick_next(struct sched_rq *rq)
+{
+	struct mlq_rq *mlq = &rq->mlq;
+	struct pcb_t *proc;
+	unsigned long cost = 0;
+	uint64_t now = current_time();
+	int prio;
+
+	/* Age at most once per time slot on each CPU */
+	if (sched_aging_slots > 0 && mlq->last_aging != now)
+	{
+		mlq->last_aging = now;
+		mlq_age(mlq, now);
+	}
+
+	prio = mlq_find_prio(mlq, &cost);
+	if (prio < 0)
+		return NULL;
+
+	proc = dequeue(&mlq->ready_queue[prio]);
+	if (empty(&mlq->ready_queue[prio]))
+		clear_bit(prio, mlq->ready_map);
+
+	if (mlq->slot_epoch[prio] != mlq->epoch)
+	{
+		mlq->slot[prio] = MAX_PRIO - prio;
+		mlq->slot_epoch[prio] = mlq->epoch;
+	}
+	if (--mlq->slot[prio] <= 0)
+		set_bit(prio, mlq->expired_map);
+
+	mlq->dispatch_cost += cost;
+	return proc;
+}
+
+/*
+ *  steal_before - whether a CPU stealing from [rq] should take [a] rather
+ *  than [b], two processes of the same level. A CPU faster than [rq]
+ *  takes the longest job, it saves the most slots on it. Any other CPU
+ *  takes the shortest, the longer ones are left for a faster thief.
+ */
+static int steal_before(struct sched_rq *rq, int cpu, struct pcb_t *a,
+			struct pcb_t *b)
+{
+	if (runqueues[cpu].speed > rq->speed)
+		return proc_remaining(a) > proc_remaining(b);
+	return proc_remaining(a) < proc_remaining(b);
+}
+
+/* Process of [q] to steal for [cpu], see steal_before(). NULL if none */
+static struct pcb_t *steal_from_queue(struct sched_rq *rq, struct queue_t *q,
+				      int cpu)
+{
+	struct pcb_t *best = NULL;
+	int i;
+
+	for (i = 0; i < q->size; i++)
+	{
+		struct pcb_t *proc = q->proc[(q->head + i) % q->capacity];
+
+		if (proc_allowed(proc, cpu) &&
+		    (best == NULL || steal_before(rq, cpu, proc, best)))
+			best = proc;
+	}
+	return best != NULL ? dequeue_proc(q, best) : NULL;
+}
+
+/*
+ *  mlq_steal - process allowed on [cpu] from the highest priority level
+ *  holding one, see steal_before(). The slot budget of [rq] is left
+ *  untouched, it only paces the dispatches of its own CPU.
+ */
+static struct pcb_t *mlq_steal(struct sched_rq *rq, int cpu)
+{
+	struct mlq_rq *mlq = &rq->mlq;
+	int w;
+
+	for (w = 0; w < BITS_TO_LONGS(MAX_PRIO); w++)
+	{
+		unsigned long bits = mlq->ready_map[w];
+
+		while (bits)
+		{
+			int prio = w * BITS_PER_LONG + __ffs(bits);
+			struct queue_t *q = &mlq->ready_queue[prio];
+			struct pcb_t *proc;
+
+			bits &= bits - 1;
+			proc = steal_from_queue(rq, q, cpu);
+			if (proc == NULL)
+				continue;
+			if (empty(q))
+				clear_bit(prio, mlq->ready_map);
+			return proc;
+		}
+	}
+	return NULL;
+}
+
+static void mlq_put_prev(struct sched_rq *rq, struct pcb_t *proc, int ran)
+{
+	/* The process got the CPU, drop what it gained by aging */
+	proc->prio = proc->base_prio;
+}
+
+static int mlq_preempt_key(struct pcb_t *proc)
+{
+	return proc->prio;
+}
+
+static void mlq_report(struct sched_rq *rqs, int nr)
+{
+	unsigned long picks = 0, cost = 0, epochs = 0, steals = 0, aged = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < nr; cpu++)
+	{
+		picks += rqs[cpu].dispatch_cnt;
+		steals += rqs[cpu].steal_cnt;
+		cost += rqs[cpu].mlq.dispatch_cost;
+		epochs += rqs[cpu].mlq.epoch_cnt;
+		aged += rqs[cpu].mlq.aging_cnt;
+	}
+	printf("MLQ dispatch: %lu picks, %lu bitmap words examined (avg %.2f), %lu epochs, %lu steals\n",
+	       picks, cost, picks ? (double)cost / picks : 0.0, epochs, steals);
+	if (sched_aging_slots > 0)
+		printf("MLQ aging: %lu promotions (every %d slots)\n",
+		       aged, sched_aging_slots);
+}
+
+const struct sched_class mlq_sched_class = {
+	.name		= "mlq",
+	.init_rq	= mlq_init_rq,
+	.free_rq	= mlq_free_rq,
+	.enqueue	= mlq_enqueue,
+	.pick_next	= mlq_pick_next,
+	.steal		= mlq_steal,
+	.put_prev	= mlq_put_prev,
+	.preempt_key	= mlq_preempt_key,
+	.report		= mlq_report,
+};
+
+/*
+ *  Multi-level feedback queue
+ *  Loaded priorities are ignored: every process starts at level 0 and
+ *  the scheduler learns its behavior. Level L runs for time_slot << L
+ *  slots. A process that burns its whole quantum drops one level, one
+ *  put back early keeps its level. Every sched_mlfq_boost slots all the
+ *  queued processes go back to level 0 so CPU-bound ones cannot starve.
+ *  Levels are served strictly in order, short jobs finish at the top.
+ */
+
+static void mlfq_init_rq(struct sched_rq *rq)
+{
+	struct mlfq_rq *mlfq = &rq->mlfq;
+	int i;
+
+	for (i = 0; i < MLFQ_LEVELS; i++)
+	{
+		init_queue(&mlfq->level[i]);
+		mlfq->dispatch_cnt[i] = 0;
+	}
+	mlfq->last_boost = 0;
+	mlfq->demote_cnt = mlfq->boost_cnt = 0;
+}
+
+static void mlfq_free_rq(struct sched_rq *rq)
+{
+	int i;
+
+	for (i = 0; i < MLFQ_LEVELS; i++)
+		free_queue(&rq->mlfq.level[i]);
+}
+
+static void mlfq_enqueue(struct sched_rq *rq, struct pcb_t *proc, int new)
+{
+	if (new)
+		proc->mlfq_level = 0;
+	enqueue(&rq->mlfq.level[proc->mlfq_level], proc);
+}
+
+static void mlfq_boost(struct mlfq_rq *mlfq)
+{
+	int i;
+
+	for (i = 1; i < MLFQ_LEVELS; i++)
+	{
+		while (!empty(&mlfq->level[i]))
+		{
+			struct pcb_t *proc = dequeue(&mlfq->level[i]);
+
+			proc->mlfq_level = 0;
+			enqueue(&mlfq->level[0], proc);
+		}
+	}
+	mlfq->boost_cnt++;
+}
+
+static struct pcb_t *mlfq_pick_next(struct sched_rq *rq)
+{
+	struct mlfq_rq *mlfq = &rq->mlfq;
+	uint64_t now = current_time();
+	int i;
+
+	if (sched_mlfq_boost > 0 && now - mlfq->last_boost >= sched_mlfq_boost)
+	{
+		mlfq->last_boost = now;
+		mlfq_boost(mlfq);
+	}
+
+	for (i = 0; i < MLFQ_LEVELS; i++)
+	{
+		if (!empty(&mlfq->level[i]))
+		{
+			mlfq->dispatch_cnt[i]++;
+			return dequeue(&mlfq->level[i]);
+		}
+	}
+	return NULL;
+}
+
+static struct pcb_t *mlfq_steal(struct sched_rq *rq, int cpu)
+{
+	struct mlfq_rq *mlfq = &rq->mlfq;
+	struct pcb_t *proc;
+	int i;
+
+	for (i = 0; i < MLFQ_LEVELS; i++)
+		if ((proc = steal_from_queue(rq, &mlfq->level[i], cpu)) != NULL)
+			return proc;
+	return NULL;
+}
+
+static void mlfq_put_prev(struct sched_rq *rq, struct pcb_t *proc, int ran)
+{
+	if (ran >= proc->quantum && proc->mlfq_level < MLFQ_LEVELS - 1)
+	{
+		proc->mlfq_level++;
+		rq->mlfq.demote_cnt++;
+	}
+}
+
+static int mlfq_quantum(struct pcb_t *proc, int time_slot)
+{
+	proc->quantum = time_slot << proc->mlfq_level;
+	return proc->quantum;
+}
+
+static int mlfq_preempt_key(struct pcb_t *proc)
+{
+	return proc->mlfq_level;
+}
+
+static void mlfq_report(struct sched_rq *rqs, int nr)
+{
+	unsigned long demoted = 0, boosts = 0;
+	int cpu, i;
+
+	for (i = 0; i < MLFQ_LEVELS; i++)
+	{
+		unsigned long cnt = 0;
+
+		for (cpu = 0; cpu < nr; cpu++)
+			cnt += rqs[cpu].mlfq.dispatch_cnt[i];
+		printf("MLFQ level %d: quantum x%d, %lu dispatches\n",
+		       i, 1 << i, cnt);
+	}
+	for (cpu = 0; cpu < nr; cpu++)
+	{
+		demoted += rqs[cpu].mlfq.demote_cnt;
+		boosts += rqs[cpu].mlfq.boost_cnt;
+	}
+	printf("MLFQ: %lu demotions, %lu boosts (every %d slots)\n",
+	       demoted, boosts, sched_mlfq_boost);
+}
+
+const struct sched_class mlfq_sched_class = {
+	.name		= "mlfq",
+	.init_rq	= mlfq_init_rq,
+	.free_rq	= mlfq_free_rq,
+	.enqueue	= mlfq_enqueue,
+	.pick_next	= mlfq_pick_next,
+	.steal		= mlfq_steal,
+	.put_prev	= mlfq_put_prev,
+	.quantum	= mlfq_quantum,
+	.preempt_key	= mlfq_preempt_key,
+	.report		= mlfq_report,
+};
+
+/* Deadline processes belong to the EDF class, which runs ahead of the policy */
+static const struct sched_class *class_of(struct pcb_t *proc)
+{
+	return proc->deadline ? &edf_sched_class : sched_class;
+}
+
+static int proc_quantum(struct pcb_t *proc, int time_slot)
+{
+	if (class_of(proc)->quantum)
+		return class_of(proc)->quantum(proc, time_slot);
+	if (sched_quantum_max == 0)
+		return time_slot;
+	if (proc->quantum == 0)
+	{
+		/* First dispatch, start from the configured time slot */
+		proc->quantum = time_slot;
+		if (proc->quantum < sched_quantum_min)
+			proc->quantum = sched_quantum_min;
+		if (proc->quantum > sched_quantum_max)
+			proc->quantum = sched_quantum_max;
+	}
+	return proc->quantum;
+}
+
+int sched_quantum(struct pcb_t *proc, int time_slot)
+{
+	int quantum = proc_quantum(proc, time_slot);
+
+	/* A replayed process runs until the trace puts it back */
+	return replay_rings ? INT_MAX : quantum;
+}
+
+/* Caller must hold rq->lock */
+static void enqueue_proc(struct sched_rq *rq, struct pcb_t *proc, int new)
+{
+	proc->running_list = &rq->running_list;
+	if (new)
+		proc->base_prio = proc->prio;
+	/* A new process may have waited in the loader inbox already */
+	proc->enqueue_time = new ? proc->arrival_time : sync_time();
+
+	class_of(proc)->enqueue(rq, proc, new);
+	__atomic_store_n(&rq->nr_running, rq->nr_running + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&rq->nr_prio[proc->base_prio],
+			 rq->nr_prio[proc->base_prio] + 1, __ATOMIC_RELAXED);
+}
+
+/* Caller must hold rq->lock, [proc] was just taken off [rq] */
+static void account_dequeue(struct sched_rq *rq, struct pcb_t *proc)
+{
+	__atomic_store_n(&rq->nr_running, rq->nr_running - 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&rq->nr_prio[proc->base_prio],
+			 rq->nr_prio[proc->base_prio] - 1, __ATOMIC_RELAXED);
+}
+
+/* Caller must hold rq->lock */
+static struct pcb_t *pick_next_proc(struct sched_rq *rq)
+{
+	struct pcb_t *proc = edf_sched_class.pick_next(rq);
+
+	if (proc == NULL)
+		proc = sched_class->pick_next(rq);
+
+	if (proc != NULL)
+		account_dequeue(rq, proc);
+	return proc;
+}
+
+/* Caller must hold victim->lock */
+static struct pcb_t *steal_next_proc(struct sched_rq *victim, int cpu)
+{
+	struct pcb_t *proc = edf_sched_class.steal(victim, cpu);
+
+	if (proc == NULL)
+		proc = sched_class->steal(victim, cpu);
+
+	if (proc != NULL)
+		account_dequeue(victim, proc);
+	return proc;
+}
+
+/* Highest loaded priority queued on [rq], MAX_PRIO if none. Lockless */
+static int top_prio(struct sched_rq *rq)
+{
+	int prio;
+
+	for (prio = 0; prio < MAX_PRIO; prio++)
+		if (__atomic_load_n(&rq->nr_prio[prio], __ATOMIC_RELAXED) > 0)
+			break;
+	return prio;
+}
+
+/* Whether [rq] should leave the work queued on [victim] alone: that CPU
+ * is faster and idle, it will run it itself */
+static int leave_to(struct sched_rq *rq, struct sched_rq *victim)
+{
+	return victim->speed > rq->speed &&
+	       __atomic_load_n(&victim->idle, __ATOMIC_RELAXED);
+}
+
+/*
+ *  steal_proc - take a process allowed on this CPU from a peer run queue
+ *  The peer holding the highest priority process is tried first, the
+ *  busiest of them on a tie, then the other non-empty ones in CPU order
+ *  in case the first only holds processes pinned elsewhere. Peers that
+ *  are faster and idle keep their work, see leave_to(). Only one run
+ *  queue lock is held at a time, victims are chosen from a lockless
+ *  snapshot of nr_prio and nr_running and rechecked under their lock.
+ *  @src: returns the run queue the process was taken from
+ */
+static struct pcb_t *steal_proc(struct sched_rq *rq, struct sched_rq **src)
+{
+	struct sched_rq *best = NULL;
+	struct pcb_t *proc = NULL;
+	int best_prio = MAX_PRIO, max_nr = 0;
+	int i;
+
+	for (i = 0; i < nr_rqs; i++)
+	{
+		int nr = __atomic_load_n(&runqueues[i].nr_running, __ATOMIC_RELAXED);
+		int prio;
+
+		if (i == rq->cpu || nr == 0 || leave_to(rq, &runqueues[i]))
+			continue;
+		prio = top_prio(&runqueues[i]);
+		if (prio < best_prio || (prio == best_prio && nr > max_nr))
+		{
+			best_prio = prio;
+			max_nr = nr;
+			best = &runqueues[i];
+		}
+	}
+	if (best == NULL)
+		return NULL;
+
+	for (i = -1; i < nr_rqs && proc == NULL; i++)
+	{
+		struct sched_rq *victim = i < 0 ? best : &runqueues[i];
+
+		if (i >= 0 && (victim == best || victim == rq || leave_to(rq, victim) ||
+			       !__atomic_load_n(&victim->nr_running, __ATOMIC_RELAXED)))
+			continue;
+		pthread_mutex_lock(&victim->lock);
+		proc = steal_next_proc(victim, rq->cpu);
+		pthread_mutex_unlock(&victim->lock);
+		*src = victim;
+	}
+
+	if (proc != NULL)
+		rq->steal_cnt++;
+	return proc;
+}
+
+/*
+ *  least_loaded_cpu - CPU [proc] is allowed on where it would wait the
+ *  least: fewest queued processes per unit of speed, the fastest on a tie.
+ *  add_proc() leaves every process at least one CPU, CPU 0 stands in
+ *  should none be allowed all the same.
+ */
+static int least_loaded_cpu(struct pcb_t *proc)
+{
+	int cpu, target = -1;
+	long load, target_load = 0;
+
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+	{
+		if (!proc_allowed(proc, cpu))
+			continue;
+		/* (nr_running + 1) / speed, compared without dividing */
+		load = __atomic_load_n(&runqueues[cpu].nr_running, __ATOMIC_RELAXED) + 1;
+		if (target < 0 ||
+		    load * runqueues[target].speed < target_load * runqueues[cpu].speed ||
+		    (load * runqueues[target].speed == target_load * runqueues[cpu].speed &&
+		     runqueues[cpu].speed > runqueues[target].speed))
+		{
+			target = cpu;
+			target_load = load;
+		}
+	}
+	return target < 0 ? 0 : target;
+}
+
+void sched_park(int cpu, struct timer_id_t *timer_id)
+{
+	struct sched_rq *rq = &runqueues[cpu];
+	uint64_t start;
+
+	pthread_mutex_lock(&park_lock);
+	__atomic_store_n(&nr_parked, nr_parked + 1, __ATOMIC_RELAXED);
+	/* Pairs with the fence in unpark_one(): either the producer sees
+	 * this CPU parked, or this CPU sees the work it queued */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (parking_closed || work_queued())
+	{
+		__atomic_store_n(&nr_parked, nr_parked - 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&park_lock);
+		next_slot(timer_id);
+		return;
+	}
+	rq->parked = timer_id;
+	park_event(timer_id);
+	pthread_mutex_unlock(&park_lock);
+
+	start = current_time();
+	next_slot(timer_id);
+	rq->park_cnt++;
+	rq->parked_slots += current_time() - start;
+}
+
+/* Caller must hold park_lock */
+static void unpark_rq(struct sched_rq *rq)
+{
+	unpark_event(rq->parked);
+	rq->parked = NULL;
+	__atomic_store_n(&nr_parked, nr_parked - 1, __ATOMIC_RELAXED);
+}
+
+/*
+ *  unpark_one - wake one parked CPU for newly queued work
+ *  CPU [cpu] is preferred, otherwise the fastest parked CPU [proc] may
+ *  run on (any parked CPU when [proc] is NULL).
+ */
+static void unpark_one(struct pcb_t *proc, int cpu)
+{
+	int i;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&nr_parked, __ATOMIC_RELAXED))
+		return;
+
+	pthread_mutex_lock(&park_lock);
+	if (cpu < 0 || !runqueues[cpu].parked)
+	{
+		/* Fastest parked CPU first */
+		cpu = -1;
+		for (i = 0; i < nr_rqs; i++)
+			if (runqueues[i].parked && (proc == NULL || proc_allowed(proc, i)) &&
+			    (cpu < 0 || runqueues[i].speed > runqueues[cpu].speed))
+				cpu = i;
+	}
+	if (cpu >= 0)
+		unpark_rq(&runqueues[cpu]);
+	pthread_mutex_unlock(&park_lock);
+}
+
+void sched_unpark_all(void)
+{
+	int i;
+
+	pthread_mutex_lock(&park_lock);
+	parking_closed = 1;
+	for (i = 0; i < nr_rqs; i++)
+		if (runqueues[i].parked)
+			unpark_rq(&runqueues[i]);
+	pthread_mutex_unlock(&park_lock);
+}
+
+/* Put a process released by its group back on the run queue of its CPU */
+static void requeue_proc(struct pcb_t *proc)
+{
+	struct sched_rq *rq = &runqueues[proc->last_cpu >= 0 ?
+					 proc->last_cpu : least_loaded_cpu(proc)];
+
+	pthread_mutex_lock(&rq->lock);
+	enqueue_proc(rq, proc, 0);
+	pthread_mutex_unlock(&rq->lock);
+	unpark_one(proc, rq->cpu);
+}
+
+int sched_add_group(const char *name, int quota, int period)
+{
+	struct sched_group *g;
+
+	if (nr_groups == SCHED_MAX_GROUPS || quota <= 0 || period <= 0)
+		return -1;
+	g = &groups[nr_groups++];
+	strncpy(g->name, name, sizeof(g->name) - 1);
+	g->quota = quota;
+	g->period = period;
+	pthread_mutex_init(&g->lock, NULL);
+	init_queue(&g->throttled_list);
+	return nr_groups;
+}
+
+int sched_find_group(const char *name)
+{
+	int i;
 
-static struct queue_t running_list; // lấy một phần tử trong mlq_ready_queue và gán vào biến running
-									// để xử lí
-#ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
-static int slot[MAX_PRIO];
-#endif
+	for (i = 0; i < nr_groups; i++)
+		if (!strcmp(groups[i].name, name))
+			return i + 1;
+	return 0;
+}
 
-int queue_empty(void)
+static struct sched_group *group_of(struct pcb_t *proc)
 {
-#ifdef MLQ_SCHED
-	unsigned long prio;
-	for (prio = 0; prio < MAX_PRIO; prio++)
-		if (!empty(&mlq_ready_queue[prio]))
-			return -1;
-#endif
-	return (empty(&ready_queue) && empty(&run_queue));
+	return proc->group ? &groups[proc->group - 1] : NULL;
 }
 
-void init_scheduler(void)
+static int group_throttled(struct pcb_t *proc)
 {
-#ifdef MLQ_SCHED
+	return proc->group &&
+	       __atomic_load_n(&groups[proc->group - 1].throttled, __ATOMIC_RELAXED);
+}
+
+/*
+ *  group_refill - start a new period if the current one is over and
+ *  release the throttled processes. Caller must not hold a run queue lock.
+ */
+static void group_refill(struct sched_group *g, uint64_t now)
+{
+	if (now - __atomic_load_n(&g->period_start, __ATOMIC_RELAXED) < g->period)
+		return;
+
+	pthread_mutex_lock(&g->lock);
+	if (now - g->period_start >= g->period)
+	{
+		g->period_start = now - (now - g->period_start) % g->period;
+		g->usage = 0;
+		__atomic_store_n(&g->throttled, 0, __ATOMIC_RELAXED);
+		while (!empty(&g->throttled_list))
+		{
+			struct pcb_t *proc = dequeue(&g->throttled_list);
+
+			/* A replayed process stays in the pool, it only
+			 * starts waiting again */
+			if (replay_rings)
+			{
+				proc->enqueue_time = sync_time();
+				continue;
+			}
+			requeue_proc(proc);
+			/* Only now, so that no CPU sees the process nowhere and exits */
+			__atomic_sub_fetch(&nr_throttled, 1, __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+}
+
+static void refill_groups(void)
+{
+	uint64_t now = sync_time();
 	int i;
 
-	for (i = 0; i < MAX_PRIO; i++)
+	for (i = 0; i < nr_groups; i++)
+		group_refill(&groups[i], now);
+}
+
+/* Park [proc] with its group until the next period, or requeue it if the
+ * period already rolled over, on behalf of [cpu]. Caller must not hold a
+ * run queue lock */
+static void throttle_proc(int cpu, struct pcb_t *proc)
+{
+	struct sched_group *g = group_of(proc);
+
+	pthread_mutex_lock(&g->lock);
+	if (g->throttled)
+	{
+		enqueue(&g->throttled_list, proc);
+		__atomic_add_fetch(&nr_throttled, 1, __ATOMIC_RELAXED);
+		g->throttled_procs++;
+		pthread_mutex_unlock(&g->lock);
+		trace_event(cpu, TRACE_THROTTLE, current_time(), proc->pid, 0);
+		return;
+	}
+	pthread_mutex_unlock(&g->lock);
+	requeue_proc(proc);
+}
+
+#ifdef MM_PAGING
+void sched_set_swap(struct memphy_struct *mram)
+{
+	int frames = mram->maxsz / PAGING_PAGESZ;
+
+	swap_ram = mram;
+	swap_low = frames * SWAP_LOW_WATERMARK / 100;
+	swap_high = frames * SWAP_HIGH_WATERMARK / 100;
+	if (swap_low < 1)
+		swap_low = 1;
+	if (swap_high <= swap_low)
+		swap_high = swap_low + 1;
+}
+
+int sched_mem_pressure(void)
+{
+	int free_fp;
+
+	if (swap_ram == NULL)
+		return 0;
+	free_fp = MEMPHY_nr_freefp(swap_ram);
+	return free_fp < swap_low ||
+	       (__atomic_load_n(&nr_swapped, __ATOMIC_RELAXED) && free_fp < swap_high);
+}
+
+/* Count [proc] as holding frames or not. A process only takes frames
+ * while it runs, put_proc() checks it every time it leaves its CPU */
+static void set_resident(struct pcb_t *proc, int resident)
+{
+	if (proc->resident == resident)
+		return;
+	proc->resident = resident;
+	__atomic_add_fetch(&nr_resident[proc->base_prio], resident ? 1 : -1,
+			   __ATOMIC_RELAXED);
+}
+
+/* Whether [proc] should be swapped out instead of being dispatched or
+ * queued: MEMRAM is short and no process holding frames has a lower
+ * priority. The last process holding frames is never swapped out */
+static int swap_victim(struct pcb_t *proc)
+{
+	int prio, nr = 0, lowest = -1;
+
+	if (swap_ram == NULL || !proc->resident ||
+	    MEMPHY_nr_freefp(swap_ram) >= swap_low)
+		return 0;
+	for (prio = MAX_PRIO - 1; prio >= 0 && nr < 2; prio--)
+	{
+		int n = __atomic_load_n(&nr_resident[prio], __ATOMIC_RELAXED);
+
+		if (n && lowest < 0)
+			lowest = prio;
+		nr += n;
+	}
+	return nr > 1 && proc->base_prio >= lowest;
+}
+
+/* Suspend [proc] with its pages in swap, on behalf of [cpu]. Return 0
+ * if nothing could be written out, the caller keeps the process. Caller
+ * must not hold a run queue lock */
+static int swap_out_proc(int cpu, struct pcb_t *proc)
+{
+	int pages = swap_out_pcb(proc);
+
+	if (pages <= 0)
+		return 0;
+	trace_event(cpu, TRACE_SWAP_OUT, current_time(), proc->pid, pages);
+	set_resident(proc, 0);
+	pthread_mutex_lock(&swap_lock);
+	enqueue(&swapped_list, proc);
+	__atomic_add_fetch(&nr_swapped, 1, __ATOMIC_RELAXED);
+	swap_out_cnt++;
+	swap_out_pages += pages;
+	pthread_mutex_unlock(&swap_lock);
+	return 1;
+}
+
+/* Bring back the oldest suspended process once MEMRAM has recovered,
+ * on behalf of [cpu]. Caller must not hold a run queue lock */
+static void swap_in_procs(int cpu)
+{
+	struct pcb_t *proc;
+
+	if (!__atomic_load_n(&nr_swapped, __ATOMIC_RELAXED) ||
+	    MEMPHY_nr_freefp(swap_ram) < swap_high ||
+	    pthread_mutex_trylock(&swap_lock))
+		return;
+	proc = dequeue(&swapped_list);
+	if (proc != NULL && swap_in_pcb(proc) < 0)
 	{
-		mlq_ready_queue[i].size = 0;
-		slot[i] = MAX_PRIO - i;
+		/* Its pages do not fit yet */
+		enqueue(&swapped_list, proc);
+		proc = NULL;
 	}
+	if (proc != NULL)
+		swap_in_cnt++;
+	pthread_mutex_unlock(&swap_lock);
+	if (proc == NULL)
+		return;
+	trace_event(cpu, TRACE_SWAP_IN, current_time(), proc->pid, 0);
+
+	set_resident(proc, 1);
+	requeue_proc(proc);
+	/* Only now, so that no CPU sees the process nowhere and exits */
+	__atomic_sub_fetch(&nr_swapped, 1, __ATOMIC_RELAXED);
+}
 #endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
-	running_list.size = 0;
-	pthread_mutex_init(&queue_lock, NULL);
+
+/* Start running [proc] on [rq]. Caller must hold rq->lock */
+static void dispatch_proc(struct sched_rq *rq, struct pcb_t *proc)
+{
+	__atomic_store_n(&rq->idle, 0, __ATOMIC_RELAXED);
+	proc->exec_start = current_time();
+	if (proc->last_cpu < 0)
+		proc->first_run = proc->exec_start;
+	else if (proc->last_cpu != rq->cpu)
+		proc->nr_migrations++;
+	proc->last_cpu = rq->cpu;
+	__atomic_store_n(&rq->curr_deadline,
+			 proc->deadline ? proc->deadline : EDF_NO_DEADLINE,
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&rq->curr_key,
+			 class_of(proc)->preempt_key ?
+			 class_of(proc)->preempt_key(proc) : -1,
+			 __ATOMIC_RELAXED);
+	rq->dispatch_cnt++;
+	rq->wait_cnt[proc->base_prio]++;
+	proc->sum_wait_time += proc->exec_start - proc->enqueue_time;
+	if (proc->exec_start - proc->enqueue_time > rq->max_wait[proc->base_prio])
+		rq->max_wait[proc->base_prio] = proc->exec_start - proc->enqueue_time;
+	proc->running_list = &rq->running_list;
+	enqueue(&rq->running_list, proc);
 }
 
-#ifdef MLQ_SCHED
-/*
- *  Stateful design for routine calling
- *  based on the priority and our MLQ policy
- *  We implement stateful here using transition technique
- *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
- */
+/* Charge the [ran] slots [proc] just ran on [rq] as it leaves the CPU.
+ * Caller must hold rq->lock */
+static void account_put(struct sched_rq *rq, struct pcb_t *proc, int ran)
+{
+	dequeue_proc(&rq->running_list, proc);
+	proc->sum_exec_runtime += ran;
+	proc->nr_switches++;
+	if (sched_quantum_max && proc->quantum && !class_of(proc)->quantum)
+	{
+		/* Batch processes spend their whole quantum, let them run
+		 * longer. Anything put back early runs shorter next time */
+		if (ran >= proc->quantum)
+			proc->quantum = proc->quantum * 2 < sched_quantum_max ?
+					proc->quantum * 2 : sched_quantum_max;
+		else
+			proc->quantum = proc->quantum / 2 > sched_quantum_min ?
+					proc->quantum / 2 : sched_quantum_min;
+	}
+	class_of(proc)->put_prev(rq, proc, ran);
+#ifdef MM_PAGING
+	if (swap_ram && proc->mm->fifo_pgn)
+		set_resident(proc, 1);
+#endif
+}
 
-struct pcb_t *get_mlq_proc(void)
+int sched_replay(const char *path)
 {
-	struct pcb_t *proc = NULL;
-	/*TODO: get a process from PRIORITY [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
-	// TODO: bắt đầu làm
-	pthread_mutex_lock(&queue_lock); // lock
-	if (queue_empty() != -1)
+	struct trace_header hdr;
+	struct trace_event ev;
+	FILE *file = fopen(path, "rb");
+
+	if (file == NULL)
+		return -1;
+	if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != TRACE_VERSION ||
+	    hdr.event_size != sizeof(struct trace_event) ||
+	    hdr.nr_cpus != (uint32_t)nr_rqs)
+	{
+		fclose(file);
+		return -1;
+	}
+	replay_rings = calloc(nr_rqs + 1, sizeof(struct replay_ring));
+	/* Events of one CPU are in time order */
+	while (fread(&ev, sizeof(ev), 1, file) == 1)
 	{
-		pthread_mutex_unlock(&queue_lock); // unlock
+		struct replay_ring *r;
+
+		if (ev.cpu > nr_rqs)
+			continue;
+		r = &replay_rings[ev.cpu];
+		if (r->nr == r->cap)
+		{
+			r->cap = r->cap ? r->cap * 2 : 256;
+			r->ev = realloc(r->ev, sizeof(struct trace_event) * r->cap);
+		}
+		r->ev[r->nr++] = ev;
+	}
+	fclose(file);
+	return 0;
+}
+
+/* Next event of [ring] if it is due by now, NULL otherwise */
+static struct trace_event *replay_peek(int ring)
+{
+	struct replay_ring *r = &replay_rings[ring];
+
+	if (r->next == r->nr || r->ev[r->next].time > current_time())
 		return NULL;
+	return &r->ev[r->next];
+}
+
+/* Move past the next event of [ring] if it is a due [type] event of [proc] */
+static void replay_consume(int ring, int type, struct pcb_t *proc)
+{
+	struct trace_event *ev = replay_peek(ring);
+
+	if (ev != NULL && ev->type == type && ev->pid == proc->pid)
+		replay_rings[ring].next++;
+}
+
+/* Leave [proc] in the pool until the trace dispatches it */
+static void replay_wait(struct pcb_t *proc)
+{
+	if (proc->pid >= replay_pool_cap)
+	{
+		uint32_t cap = replay_pool_cap ? replay_pool_cap : 64;
+
+		while (cap <= proc->pid)
+			cap *= 2;
+		replay_pool = realloc(replay_pool, sizeof(struct pcb_t *) * cap);
+		memset(replay_pool + replay_pool_cap, 0,
+		       sizeof(struct pcb_t *) * (cap - replay_pool_cap));
+		replay_pool_cap = cap;
+	}
+	replay_pool[proc->pid] = proc;
+	replay_nr_waiting++;
+}
+
+int sched_replay_admit(void)
+{
+	struct replay_ring *r = &replay_rings[nr_rqs];
+
+	while (r->next < r->nr && r->ev[r->next].type != TRACE_ADMIT)
+		r->next++;
+	if (r->next == r->nr)
+		return -1;
+	return r->ev[r->next].time <= current_time();
+}
+
+/* add_proc() of a replay: [proc] waits for its first DISPATCH, and the
+ * CPUs its arrival preempted count it */
+static void replay_admit(struct pcb_t *proc)
+{
+	struct trace_event *ev;
+
+	replay_consume(nr_rqs, TRACE_ADMIT, proc);
+	while ((ev = replay_peek(nr_rqs)) != NULL &&
+	       ev->type == TRACE_KICK && ev->pid == proc->pid)
+	{
+		if (ev->arg < (uint32_t)nr_rqs)
+			runqueues[ev->arg].preempt_cnt++;
+		trace_event(nr_rqs, TRACE_KICK, current_time(), proc->pid, ev->arg);
+		replay_rings[nr_rqs].next++;
 	}
-	// duyệt qua mlq_ready_queue theo thứ tự ưu tiên từ cao (0) đến thấp nhất (MAX_PRIO - 1)
-	for (int prio = 0; prio < MAX_PRIO; prio++)
+	proc->base_prio = proc->prio;
+	proc->enqueue_time = proc->arrival_time;
+	replay_wait(proc);
+}
+
+/* get_proc() of a replay: replay the due events of CPU [cpu] up to its
+ * next DISPATCH */
+static struct pcb_t *replay_get_proc(int cpu)
+{
+	struct sched_rq *rq = &runqueues[cpu];
+	struct trace_event *ev;
+	struct pcb_t *proc;
+
+	refill_groups();
+	while ((ev = replay_peek(cpu)) != NULL)
 	{
-		if (!empty(&mlq_ready_queue[prio]))
+		replay_rings[cpu].next++;
+		proc = ev->pid < replay_pool_cap ? replay_pool[ev->pid] : NULL;
+		switch (ev->type)
 		{
-			if (slot[prio] > 0)
+		case TRACE_IDLE:
+			if (!rq->idle)
 			{
-				proc = dequeue(&mlq_ready_queue[prio]);
-				slot[prio]--;
-				enqueue(&running_list, proc);
-				pthread_mutex_unlock(&queue_lock); // unlock
-				return proc;
+				rq->idle_since = current_time();
+				__atomic_store_n(&rq->idle, 1, __ATOMIC_RELAXED);
+				trace_event(cpu, TRACE_IDLE, rq->idle_since, 0, 0);
 			}
-			else if(slot[prio] == 0) // nếu queue có tiến trình nhưng mà slot đã hết
+			break;
+		case TRACE_STEAL:
+			rq->steal_cnt++;
+			trace_event(cpu, TRACE_STEAL, current_time(), ev->pid, ev->arg);
+			break;
+		case TRACE_THROTTLE:
+			if (proc == NULL || group_of(proc) == NULL)
+				break;
+			/* Until group_refill() starts its wait over */
+			pthread_mutex_lock(&group_of(proc)->lock);
+			enqueue(&group_of(proc)->throttled_list, proc);
+			group_of(proc)->throttled_procs++;
+			pthread_mutex_unlock(&group_of(proc)->lock);
+			trace_event(cpu, TRACE_THROTTLE, current_time(), proc->pid, 0);
+			break;
+#ifdef MM_PAGING
+		case TRACE_SWAP_OUT:
+		{
+			int pages;
+
+			if (proc == NULL || (pages = swap_out_pcb(proc)) <= 0)
+				break;
+			trace_event(cpu, TRACE_SWAP_OUT, current_time(), proc->pid, pages);
+			set_resident(proc, 0);
+			swap_out_cnt++;
+			swap_out_pages += pages;
+			break;
+		}
+		case TRACE_SWAP_IN:
+			if (proc == NULL || swap_in_pcb(proc) < 0)
+				break;
+			trace_event(cpu, TRACE_SWAP_IN, current_time(), proc->pid, 0);
+			set_resident(proc, 1);
+			swap_in_cnt++;
+			proc->enqueue_time = sync_time();
+			break;
+#endif
+		case TRACE_DISPATCH:
+			/* Skipped if the process is elsewhere, the replay of
+			 * a trace of another configuration went its own way */
+			if (proc == NULL)
+				break;
+			replay_pool[proc->pid] = NULL;
+			replay_nr_waiting--;
+			/* Still throttled only if the replay went its own way */
+			if (group_of(proc))
 			{
-				// tăng độ ưu tiên của tiến trình đó lên 1 //!(này không chắc lắm)
-				if(proc->prio - 1 >= 0)
-				{
-					proc->prio--;
-				}
-				// ! Còn trường hợp proc->prio - 1 == 0 thì làm sao ? 
+				pthread_mutex_lock(&group_of(proc)->lock);
+				dequeue_proc(&group_of(proc)->throttled_list, proc);
+				pthread_mutex_unlock(&group_of(proc)->lock);
 			}
+			pthread_mutex_lock(&rq->lock);
+			dispatch_proc(rq, proc);
+			pthread_mutex_unlock(&rq->lock);
+			trace_event(cpu, TRACE_DISPATCH, proc->exec_start, proc->pid, proc->prio);
+			return proc;
+		default:
+			break;
 		}
 	}
-	pthread_mutex_unlock(&queue_lock); // unlock
-	// TODO: END
-	return proc;
+	return NULL;
 }
 
-// // chat gpt
-// struct pcb_t *get_mlq_proc(void) {
-//     struct pcb_t *proc = NULL;
-//     pthread_mutex_lock(&queue_lock);
-//     for (int prio = 0; prio < MAX_PRIO; prio++) {
-//         if (!empty(&mlq_ready_queue[prio])) {
-//             proc = dequeue(&mlq_ready_queue[prio]);
-//             slot[prio]--;
-//             if (slot[prio] == 0) {
-//                 // Reset slot count and move to next priority level
-//                 slot[prio] = MAX_PRIO - prio;
-//             }
-//             break;  // Lấy được tiến trình thì dừng ngay
-//         }
-//     }
-//     pthread_mutex_unlock(&queue_lock);
-//     return proc;
-// }
-
-// // của github
-// struct pcb_t *get_mlq_proc(void) {
-// 	struct pcb_t *proc = NULL;
-// 	/*TODO: get a process from PRIORITY [ready_queue].
-// 	 * Remember to use lock to protect the queue.
-// 	 * */
-//     static int curr_prio = 0;
-//     static int curr_slot = MAX_PRIO;
-// 	pthread_mutex_lock(&queue_lock);
-//     if (queue_empty() != -1) {
-//         pthread_mutex_unlock(&queue_lock);
-//         return NULL;
-//     }
-//     // get the process with greatest priority
-//     for (int i = 0; i < curr_prio; i++) {
-//         if (!empty(&mlq_ready_queue[i])) {
-//             curr_prio = i;
-//             curr_slot = MAX_PRIO - i - 1;
-//             proc = dequeue(&mlq_ready_queue[i]);
-//             pthread_mutex_unlock(&queue_lock);
-//             return proc;
-//         }
-//     }
-//     // if there is a process with the same priority and curr_slot > 0
-//     if (!empty(&mlq_ready_queue[curr_prio]) && curr_slot > 0) {
-//         proc = dequeue(&mlq_ready_queue[curr_prio]);
-//         curr_slot--;
-//         pthread_mutex_unlock(&queue_lock);
-//         return proc;
-//     }
-//     // slot went out, check for the next priority
-//     for (int i = curr_prio + 1; i < MAX_PRIO; i++) {
-//         if (!empty(&mlq_ready_queue[i])) {
-//             curr_prio = i;
-//             curr_slot = MAX_PRIO - i - 1;
-//             proc = dequeue(&mlq_ready_queue[i]);
-//             pthread_mutex_unlock(&queue_lock);
-//             return proc;
-//         }
-//     }
-//     // last resort, forced to get the process with the current priority
-//     if (!empty(&mlq_ready_queue[curr_prio])) {
-//         proc = dequeue(&mlq_ready_queue[curr_prio]);
-//     }
-// 	pthread_mutex_unlock(&queue_lock);
-// 	return proc;
-// }
-
-void put_mlq_proc(struct pcb_t *proc)
+void sched_tick(int cpu, struct pcb_t *proc)
 {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+	struct sched_group *g = group_of(proc);
+	int throttled;
+
+	runqueues[cpu].busy_slots++;
+	if (g == NULL)
+		return;
+
+	group_refill(g, sync_time());
+	pthread_mutex_lock(&g->lock);
+	g->usage++;
+	g->total_usage++;
+	if (g->usage >= g->quota && !g->throttled)
+	{
+		__atomic_store_n(&g->throttled, 1, __ATOMIC_RELAXED);
+		g->throttle_cnt++;
+	}
+	throttled = g->throttled;
+	pthread_mutex_unlock(&g->lock);
+
+	/* Every CPU running a process of the group gives it up */
+	if (throttled)
+		__atomic_store_n(&runqueues[cpu].need_resched, 1, __ATOMIC_RELAXED);
 }
 
-void add_mlq_proc(struct pcb_t *proc)
+struct pcb_t *get_proc(int cpu)
 {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+	struct sched_rq *rq = &runqueues[cpu];
+	struct pcb_t *proc;
+
+	if (replay_rings)
+		return replay_get_proc(cpu);
+	refill_groups();
+#ifdef MM_PAGING
+	swap_in_procs(cpu);
+#endif
+retry:
+	pthread_mutex_lock(&rq->lock);
+	__atomic_store_n(&rq->need_resched, 0, __ATOMIC_RELAXED);
+	/* Admit one newly loaded process, if any, before picking. Leave it
+	 * to a faster CPU if one is idle, it was unparked for it */
+	proc = nr_faster_idle(rq) ? NULL : spmc_pop(&ld_inbox);
+	if (proc != NULL)
+		enqueue_proc(rq, proc, 1);
+	proc = pick_next_proc(rq);
+	if (proc == NULL)
+	{
+		struct sched_rq *src;
+
+		if (!rq->idle)
+		{
+			rq->idle_since = current_time();
+			__atomic_store_n(&rq->idle, 1, __ATOMIC_RELAXED);
+			trace_event(cpu, TRACE_IDLE, rq->idle_since, 0, 0);
+		}
+		pthread_mutex_unlock(&rq->lock);
+		/* Soft affinity, let the peers run their own processes unless
+		 * this CPU has been starving for a while */
+		if (current_time() - rq->idle_since < sched_migration_delay)
+			return NULL;
+		proc = steal_proc(rq, &src);
+		if (proc == NULL)
+			return NULL;
+		pthread_mutex_lock(&rq->lock);
+		if (class_of(proc)->migrate)
+			class_of(proc)->migrate(src, rq, proc);
+		trace_event(cpu, TRACE_STEAL, current_time(), proc->pid, src->cpu);
+	}
+	if (group_throttled(proc))
+	{
+		/* Its group spent the quota while it was queued */
+		pthread_mutex_unlock(&rq->lock);
+		throttle_proc(cpu, proc);
+		goto retry;
+	}
+#ifdef MM_PAGING
+	if (swap_victim(proc))
+	{
+		pthread_mutex_unlock(&rq->lock);
+		if (swap_out_proc(cpu, proc))
+			goto retry;
+		pthread_mutex_lock(&rq->lock);
+	}
+#endif
+	dispatch_proc(rq, proc);
+	pthread_mutex_unlock(&rq->lock);
+	trace_event(cpu, TRACE_DISPATCH, proc->exec_start, proc->pid, proc->prio);
+	return proc;
+}
+
+void put_proc(int cpu, struct pcb_t *proc)
+{
+	struct sched_rq *rq = &runqueues[cpu];
+	int ran = current_time() - proc->exec_start;
+	int target;
+
+	trace_event(cpu, TRACE_PREEMPT, current_time(), proc->pid, ran);
+	pthread_mutex_lock(&rq->lock);
+	account_put(rq, proc, ran);
+	if (replay_rings)
+	{
+		/* It waits for the next DISPATCH of the trace */
+		replay_consume(cpu, TRACE_PREEMPT, proc);
+		proc->enqueue_time = sync_time();
+		replay_wait(proc);
+		pthread_mutex_unlock(&rq->lock);
+		return;
+	}
+	if (group_throttled(proc))
+	{
+		pthread_mutex_unlock(&rq->lock);
+		throttle_proc(cpu, proc);
+		return;
+	}
+#ifdef MM_PAGING
+	if (swap_victim(proc))
+	{
+		pthread_mutex_unlock(&rq->lock);
+		if (swap_out_proc(cpu, proc))
+			return;
+		pthread_mutex_lock(&rq->lock);
+	}
+#endif
+	target = faster_idle_cpu(rq, proc);
+	if (target >= 0)
+	{
+		/* A faster CPU has nothing to do, it runs the process next
+		 * instead of this one */
+		struct sched_rq *dst = &runqueues[target];
+
+		pthread_mutex_unlock(&rq->lock);
+		pthread_mutex_lock(&dst->lock);
+		if (class_of(proc)->migrate)
+			class_of(proc)->migrate(rq, dst, proc);
+		enqueue_proc(dst, proc, 0);
+		pthread_mutex_unlock(&dst->lock);
+		unpark_one(proc, target);
+		return;
+	}
+	enqueue_proc(rq, proc, 0);
+	pthread_mutex_unlock(&rq->lock);
+
+	/* This CPU takes one process back right away, the rest is work
+	 * for a parked peer */
+	if (__atomic_load_n(&rq->nr_running, __ATOMIC_RELAXED) > 1)
+		unpark_one(NULL, -1);
 }
 
-struct pcb_t *get_proc(void)
+/*
+ *  add_edf_proc - admit a deadline process
+ *  The fastest idle CPU takes it as is. Otherwise the CPU running the process with
+ *  the latest deadline (or no deadline at all) is asked to reschedule at
+ *  the next slot boundary if that deadline is later than the new one.
+ */
+static void add_edf_proc(struct pcb_t *proc)
 {
-	return get_mlq_proc();
+	struct sched_rq *rq;
+	uint64_t latest = proc->deadline;
+	int cpu, target = -1, preempt = 0, idle = -1;
+
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+	{
+		uint64_t curr;
+
+		rq = &runqueues[cpu];
+		if (!proc_allowed(proc, cpu))
+			continue;
+		if (__atomic_load_n(&rq->idle, __ATOMIC_RELAXED) &&
+		    !__atomic_load_n(&rq->nr_running, __ATOMIC_RELAXED))
+		{
+			if (idle < 0 || rq->speed > runqueues[idle].speed)
+				idle = cpu;
+			continue;
+		}
+		curr = __atomic_load_n(&rq->curr_deadline, __ATOMIC_RELAXED);
+		if (curr > latest)
+		{
+			latest = curr;
+			target = cpu;
+			preempt = 1;
+		}
+	}
+	if (idle >= 0)
+	{
+		target = idle;
+		preempt = 0;
+	}
+	/* Every CPU runs a tighter deadline, queue on the least loaded */
+	if (target < 0)
+		target = least_loaded_cpu(proc);
+
+	rq = &runqueues[target];
+	pthread_mutex_lock(&rq->lock);
+	enqueue_proc(rq, proc, 1);
+	if (preempt)
+		__atomic_store_n(&rq->need_resched, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&rq->lock);
+	unpark_one(proc, target);
 }
 
-void put_proc(struct pcb_t *proc)
+/*
+ *  preempt_on_arrival - queue [proc] on the CPU running the highest
+ *  preemption rank and have it reschedule at the next slot boundary.
+ *  Return 0 without queuing if a CPU is idle or nothing ranks below [proc].
+ */
+static int preempt_on_arrival(struct pcb_t *proc)
 {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = &running_list;
+	struct sched_rq *rq;
+	int key = sched_class->preempt_key(proc);
+	int cpu, target = -1;
 
-	/* TODO: put running proc to running_list */
-	dequeue(&running_list);
+	for (cpu = 0; cpu < nr_rqs; cpu++)
+	{
+		int curr;
+
+		rq = &runqueues[cpu];
+		if (!proc_allowed(proc, cpu))
+			continue;
+		if (__atomic_load_n(&rq->idle, __ATOMIC_RELAXED))
+			return 0;
+		curr = __atomic_load_n(&rq->curr_key, __ATOMIC_RELAXED);
+		/* The faster of two CPUs running the same rank */
+		if (curr > key ||
+		    (target >= 0 && curr == key && rq->speed > runqueues[target].speed))
+		{
+			key = curr;
+			target = cpu;
+		}
+	}
+	if (target < 0)
+		return 0;
 
-	return put_mlq_proc(proc);
+	rq = &runqueues[target];
+	pthread_mutex_lock(&rq->lock);
+	enqueue_proc(rq, proc, 1);
+	__atomic_store_n(&rq->need_resched, 1, __ATOMIC_RELAXED);
+	rq->preempt_cnt++;
+	pthread_mutex_unlock(&rq->lock);
+	trace_event(nr_rqs, TRACE_KICK, current_time(), proc->pid, target);
+	return 1;
 }
 
+/* add_proc - admit a new process, must only be called by the loader */
 void add_proc(struct pcb_t *proc)
 {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = &running_list;
+	unsigned long mask = nr_rqs < AFFINITY_BITS ? (1UL << nr_rqs) - 1 : ~0UL;
+	struct sched_rq *rq;
 
-	/* TODO: put running proc to running_list */
-	// enqueue(&running_list, proc);
+	proc->arrival_time = sync_time();
+	trace_event(nr_rqs, TRACE_ADMIT, current_time(), proc->pid, 0);
+	proc->last_cpu = -1;
+	proc->nr_migrations = 0;
+	proc->quantum = 0;
+	proc->nr_switches = 0;
+#ifdef MM_PAGING
+	proc->resident = 0;
+#endif
+	if (proc->affinity && !(proc->affinity & mask))
+	{
+		log_printf(LOG_SCHED, "PID %d: affinity %#lx has no CPU, ignored\n",
+		       proc->pid, proc->affinity);
+		proc->affinity = 0;
+	}
+	/* Drop the CPUs that do not exist */
+	proc->affinity &= mask;
 
-	return add_mlq_proc(proc);
+	if (replay_rings)
+		return replay_admit(proc);
+	if (proc->deadline)
+		return add_edf_proc(proc);
+	if (sched_arrival_preempt && sched_class->preempt_key &&
+	    preempt_on_arrival(proc))
+		return;
+
+	/* Any CPU may pop the inbox, pinned processes are placed directly */
+	if (proc->affinity == 0 && spmc_push(&ld_inbox, proc) == 0)
+	{
+		unpark_one(NULL, -1);
+		return;
+	}
+
+	/* Pinned, or the inbox is full: use the least loaded allowed CPU */
+	rq = &runqueues[least_loaded_cpu(proc)];
+	pthread_mutex_lock(&rq->lock);
+	enqueue_proc(rq, proc, 1);
+	pthread_mutex_unlock(&rq->lock);
+	unpark_one(proc, rq->cpu);
+}
+
+void finish_proc(int cpu, struct pcb_t *proc)
+{
+	struct sched_rq *rq = &runqueues[cpu];
+	struct proc_stat *st;
+	int ran = current_time() - proc->exec_start;
+
+	trace_event(cpu, TRACE_FINISH, current_time(), proc->pid, ran);
+	if (replay_rings)
+		replay_consume(cpu, TRACE_FINISH, proc);
+	proc->sum_exec_runtime += ran;
+	pthread_mutex_lock(&rq->lock);
+	dequeue_proc(&rq->running_list, proc);
+	pthread_mutex_unlock(&rq->lock);
+#ifdef MM_PAGING
+	set_resident(proc, 0);
+#endif
+
+	pthread_mutex_lock(&stats_lock);
+	if (nr_proc_stats == proc_stats_cap)
+	{
+		proc_stats_cap = proc_stats_cap ? proc_stats_cap * 2 : 16;
+		proc_stats = realloc(proc_stats, sizeof(struct proc_stat) * proc_stats_cap);
+	}
+	st = &proc_stats[nr_proc_stats++];
+	st->pid = proc->pid;
+	st->prio = proc->base_prio;
+	st->arrival = proc->arrival_time;
+	st->first_run = proc->first_run;
+	st->deadline = proc->deadline;
+	st->finish = current_time();
+	st->migrations = proc->nr_migrations;
+	st->switches = proc->nr_switches;
+	st->quantum = proc->quantum;
+	st->tickets = proc->tickets;
+	st->runtime = proc->sum_exec_runtime;
+	st->wait = proc->sum_wait_time;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+int need_resched(int cpu)
+{
+	struct trace_event *ev;
+
+	if (replay_rings)
+		return (ev = replay_peek(cpu)) != NULL && ev->type == TRACE_PREEMPT;
+	return __atomic_load_n(&runqueues[cpu].need_resched, __ATOMIC_RELAXED);
+}
+
+int sched_keep_cpu(int cpu)
+{
+	int i;
+
+	for (i = 0; i < nr_rqs; i++)
+		if (runqueues[i].speed < runqueues[cpu].speed &&
+		    !__atomic_load_n(&runqueues[i].idle, __ATOMIC_RELAXED))
+			return 1;
+	return 0;
 }
 #else
-struct pcb_t *get_proc(void)
+struct pcb_t *get_proc(int cpu)
 {
 	struct pcb_t *proc = NULL;
 	/*TODO: get a process from [ready_queue].
@@ -220,15 +2068,13 @@ struct pcb_t *get_proc(void)
 	return proc;
 }
 
-void put_proc(struct pcb_t *proc)
+void put_proc(int cpu, struct pcb_t *proc)
 {
 	proc->ready_queue = &ready_queue;
 	proc->running_list = &running_list;
 
-	/* TODO: put running proc to running_list */
-
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&run_queue, proc);
+	enqueue(&ready_queue, proc);
 	pthread_mutex_unlock(&queue_lock);
 }
 
@@ -243,4 +2089,67 @@ void add_proc(struct pcb_t *proc)
 	enqueue(&ready_queue, proc);
 	pthread_mutex_unlock(&queue_lock);
 }
+
+void finish_proc(int cpu, struct pcb_t *proc)
+{
+}
+
+int sched_quantum(struct pcb_t *proc, int time_slot)
+{
+	return time_slot;
+}
+
+void sched_park(int cpu, struct timer_id_t *timer_id)
+{
+	next_slot(timer_id);
+}
+
+void sched_unpark_all(void)
+{
+}
+
+int sched_add_group(const char *name, int quota, int period)
+{
+	return -1;
+}
+
+int sched_find_group(const char *name)
+{
+	return 0;
+}
+
+void sched_tick(int cpu, struct pcb_t *proc)
+{
+}
+
+#ifdef MM_PAGING
+void sched_set_swap(struct memphy_struct *mram)
+{
+}
+
+int sched_mem_pressure(void)
+{
+	return 0;
+}
+#endif
+
+int need_resched(int cpu)
+{
+	return 0;
+}
+
+int sched_keep_cpu(int cpu)
+{
+	return 0;
+}
+
+int sched_replay(const char *path)
+{
+	return -1;
+}
+
+int sched_replay_admit(void)
+{
+	return -1;
+}
 #endif
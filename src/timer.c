@@ -1,9 +1,32 @@
-
 #include "timer.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+
+/*
+ *  Slot barrier
+ *  Every attached device that is neither parked nor detached takes part
+ *  in a slot. The last one to call next_slot() starts the next slot:
+ *  it advances the time, re-arms the pending count and bumps the
+ *  generation the others are waiting on. Arriving is a single atomic
+ *  decrement, only the last device, the devices that go to sleep and the
+ *  rare park/unpark/detach events take slot_lock.
+ *
+ *  Sleeping uses a condition variable rather than a raw futex: syscall()
+ *  is the name of the simulated system call entry, see syscall.h.
+ */
+#define TIMER_SPIN 100	// Generation checks before going to sleep
 
-static pthread_t _timer;
+/*
+ *  Relaxed synchronization
+ *  With a quantum of K slots a device only goes through the barrier
+ *  every K calls to next_slot(). In between it runs on its own clock,
+ *  current_time() is the time of the last barrier plus the slots it ran
+ *  past it, so clocks are at most K - 1 slots apart. Events other
+ *  devices compare against are stamped with sync_time(), the time of the
+ *  last barrier, which no device clock is behind of.
+ */
 
 struct timer_id_container_t {
 	struct timer_id_t id;
@@ -15,79 +38,186 @@ static struct timer_id_container_t * dev_list = NULL;
 static uint64_t _time;
 
 static int timer_started = 0;
-static int timer_stop = 0;
-
-
-static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		printf("Time slot %3lu\n", current_time());
-		int fsh = 0;
-		int event = 0;
-		/* Wait for all devices have done the job in current
-		 * time slot */
-		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
-			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
-		}
-		/* Increase the time slot */
-		_time++;
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
-			pthread_mutex_unlock(&temp->id.timer_lock);
+
+static pthread_mutex_t slot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slot_cond = PTHREAD_COND_INITIALIZER;
+static int nr_active;		// Devices taking part in the next slot
+static int pending;		// Devices yet to finish the current slot
+static uint32_t generation;	// Bumped at every slot
+static int nr_sleeping;		// Devices waiting on slot_cond
+
+static struct timespec start_ts;
+
+static int sync_quantum = 1;		// Slots between two barriers
+static __thread uint32_t local_ahead;	// Slots this device ran past _time
+static uint64_t skew_events;		// sync_time() calls ahead of the barrier
+static uint64_t skew_slots;		// Slots they were moved back in total
+static int report_wall_clock = 1;
+
+/* Start the next slot, called by the last device of the current one */
+static void advance_slot(void) {
+	int i;
+
+	pthread_mutex_lock(&slot_lock);
+	for (i = 0; i < sync_quantum; i++) {
+		__atomic_store_n(&_time, _time + 1, __ATOMIC_RELEASE);
+		if (nr_active > 0) {
+			log_printf(LOG_TIME, "Time slot %3lu\n", _time);
 		}
-		if (fsh == event) {
-			break;
+	}
+	__atomic_store_n(&pending, nr_active, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+	if (nr_sleeping > 0) {
+		pthread_cond_broadcast(&slot_cond);
+	}
+	pthread_mutex_unlock(&slot_lock);
+}
+
+static void slot_arrive(void) {
+	if (__atomic_sub_fetch(&pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		advance_slot();
+	}
+}
+
+/* Wait until the generation is no longer [gen] */
+static void wait_generation(uint32_t gen) {
+	int spin;
+
+	for (spin = 0; spin < TIMER_SPIN; spin++) {
+		if (__atomic_load_n(&generation, __ATOMIC_ACQUIRE) != gen) {
+			return;
 		}
 	}
-	pthread_exit(args);
+	pthread_mutex_lock(&slot_lock);
+	nr_sleeping++;
+	while (generation == gen) {
+		pthread_cond_wait(&slot_cond, &slot_lock);
+	}
+	nr_sleeping--;
+	pthread_mutex_unlock(&slot_lock);
 }
 
 void next_slot(struct timer_id_t * timer_id) {
+	uint32_t gen;
+
+	/* Keep running on the local clock until the end of the quantum */
+	if (++local_ahead < sync_quantum &&
+	    !__atomic_load_n(&timer_id->parked, __ATOMIC_RELAXED)) {
+		return;
+	}
+	local_ahead = 0;
+
+	/* Read before arriving, the slot may end right after */
+	gen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+
 	/* Tell to timer that we have done our job in current slot */
-	pthread_mutex_lock(&timer_id->event_lock);
-	timer_id->done = 1;
-	pthread_cond_signal(&timer_id->event_cond);
-	pthread_mutex_unlock(&timer_id->event_lock);
+	slot_arrive();
+
+	/* A parked device sleeps on its own condition, it is not woken at
+	 * every slot, then resumes at the slot it is counted in again */
+	if (__atomic_load_n(&timer_id->parked, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&slot_lock);
+		while (timer_id->parked) {
+			pthread_cond_wait(&timer_id->park_cond, &slot_lock);
+		}
+		pthread_mutex_unlock(&slot_lock);
+		while ((int32_t)((gen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE)) -
+				 timer_id->resume_gen) < 0) {
+			wait_generation(gen);
+		}
+		return;
+	}
 
 	/* Wait for going to next slot */
-	pthread_mutex_lock(&timer_id->timer_lock);
-	while (timer_id->done) {
-		pthread_cond_wait(
-			&timer_id->timer_cond,
-			&timer_id->timer_lock
-		);
+	wait_generation(gen);
+}
+
+void park_event(struct timer_id_t * timer_id) {
+	pthread_mutex_lock(&slot_lock);
+	if (!timer_id->parked) {
+		nr_active--;
+		__atomic_store_n(&timer_id->parked, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&slot_lock);
+}
+
+void unpark_event(struct timer_id_t * timer_id) {
+	pthread_mutex_lock(&slot_lock);
+	if (timer_id->parked) {
+		nr_active++;
+		timer_id->resume_gen = generation + 1;
+		__atomic_store_n(&timer_id->parked, 0, __ATOMIC_RELEASE);
+		pthread_cond_signal(&timer_id->park_cond);
+	}
+	pthread_mutex_unlock(&slot_lock);
+}
+
+int skip_slots(struct timer_id_t * timer_id, uint64_t until) {
+	uint64_t t;
+
+	if (__atomic_load_n(&nr_active, __ATOMIC_RELAXED) != 1) {
+		return 0;
+	}
+	pthread_mutex_lock(&slot_lock);
+	/* The caller has not arrived yet, so with a single pending device
+	 * it is the only one taking part in the slots */
+	if (nr_active != 1 || pending != 1 || timer_id->parked ||
+	    timer_id->fsh || _time + local_ahead >= until) {
+		pthread_mutex_unlock(&slot_lock);
+		return 0;
+	}
+	generation += until - _time;
+	local_ahead = 0;
+	for (t = _time + 1; t <= until; t++) {
+		__atomic_store_n(&_time, t, __ATOMIC_RELEASE);
+		log_printf(LOG_TIME, "Time slot %3lu\n", t);
+	}
+	pthread_mutex_unlock(&slot_lock);
+	return 1;
+}
+
+void step_slots(uint64_t until) {
+	while (_time < until) {
+		__atomic_store_n(&_time, _time + 1, __ATOMIC_RELEASE);
+		log_printf(LOG_TIME, "Time slot %3lu\n", _time);
 	}
-	pthread_mutex_unlock(&timer_id->timer_lock);
 }
 
 uint64_t current_time() {
-	return _time;
+	return __atomic_load_n(&_time, __ATOMIC_ACQUIRE) + local_ahead;
+}
+
+uint64_t sync_time() {
+	if (local_ahead) {
+		__atomic_add_fetch(&skew_events, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&skew_slots, local_ahead, __ATOMIC_RELAXED);
+	}
+	return __atomic_load_n(&_time, __ATOMIC_RELAXED);
+}
+
+void set_sync_quantum(int slots) {
+	sync_quantum = slots > 1 ? slots : 1;
+}
+
+void set_timer_wall_clock(int on) {
+	report_wall_clock = on;
 }
 
 void start_timer() {
 	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+	pending = nr_active;
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+	log_printf(LOG_TIME, "Time slot %3lu\n", current_time());
 }
 
 void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
+	local_ahead = 0;
+	pthread_mutex_lock(&slot_lock);
 	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
+	nr_active--;
+	pthread_mutex_unlock(&slot_lock);
+	/* A detached device counts as done for the current slot */
+	slot_arrive();
 }
 
 struct timer_id_t * attach_event() {
@@ -96,14 +226,13 @@ struct timer_id_t * attach_event() {
 	}else{
 		struct timer_id_container_t * container =
 			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
+				sizeof(struct timer_id_container_t)
 			);
-		container->id.done = 0;
 		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
+		container->id.parked = 0;
+		container->id.resume_gen = 0;
+		pthread_cond_init(&container->id.park_cond, NULL);
+		nr_active++;
 		if (dev_list == NULL) {
 			dev_list = container;
 			dev_list->next = NULL;
@@ -116,19 +245,29 @@ struct timer_id_t * attach_event() {
 }
 
 void stop_timer() {
-	timer_stop = 1;
-	pthread_join(_timer, NULL);
+	struct timespec end_ts;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &end_ts);
+	elapsed = (end_ts.tv_sec - start_ts.tv_sec) +
+		  (end_ts.tv_nsec - start_ts.tv_nsec) / 1e9;
+	if (report_wall_clock) {
+		printf("Timer: %lu slots in %.3f s (%.0f slots/s)\n",
+		       current_time(), elapsed,
+		       elapsed > 0 ? current_time() / elapsed : 0.0);
+	} else {
+		printf("Timer: %lu slots\n", current_time());
+	}
+	if (sync_quantum > 1) {
+		printf("Relaxed sync: %d slot quantum, %lu events stamped up to %d slots early (%.2f on average)\n",
+		       sync_quantum, skew_events, sync_quantum - 1,
+		       skew_events ? (double)skew_slots / skew_events : 0.0);
+	}
 	while (dev_list != NULL) {
 		struct timer_id_container_t * temp = dev_list;
 		dev_list = dev_list->next;
-		pthread_cond_destroy(&temp->id.event_cond);
-		pthread_mutex_destroy(&temp->id.event_lock);
-		pthread_cond_destroy(&temp->id.timer_cond);
-		pthread_mutex_destroy(&temp->id.timer_lock);
+		pthread_cond_destroy(&temp->id.park_cond);
 		free(temp);
 	}
+	timer_started = 0;
 }
-
-
-
-
@@ -0,0 +1,198 @@
+/*
+ * trace-gantt - turn a scheduler trace written with os -t into a Gantt chart
+ *
+ * Usage: trace-gantt [-c] trace-file
+ *   default : one row per CPU, one column per time slot, showing the pid
+ *             running in that slot ('.' when idle)
+ *   -c      : CSV, one line per run of a process on a CPU
+ */
+
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* One uninterrupted run of a process on a CPU */
+struct segment {
+	int cpu;
+	uint32_t pid;
+	uint32_t start;
+	uint32_t end;		// First slot it no longer runs
+	int end_type;		// TRACE_PREEMPT, TRACE_FINISH or 0 if cut short
+	int stolen_from;	// CPU it was stolen from, -1 if none
+};
+
+struct run_state {
+	uint32_t pid;		// 0 when nothing runs
+	uint32_t start;
+	int stolen_from;
+};
+
+static struct segment *segs;
+static int nr_segs, segs_cap;
+
+static void add_segment(int cpu, struct run_state *r, uint32_t end, int type)
+{
+	struct segment *s;
+
+	if (nr_segs == segs_cap)
+	{
+		segs_cap = segs_cap ? segs_cap * 2 : 256;
+		segs = realloc(segs, sizeof(struct segment) * segs_cap);
+	}
+	s = &segs[nr_segs++];
+	s->cpu = cpu;
+	s->pid = r->pid;
+	s->start = r->start;
+	s->end = end > r->start ? end : r->start + 1;
+	s->end_type = type;
+	s->stolen_from = r->stolen_from;
+	r->pid = 0;
+	r->stolen_from = -1;
+}
+
+static const char *end_name(int type)
+{
+	switch (type)
+	{
+	case TRACE_PREEMPT:
+		return "preempt";
+	case TRACE_FINISH:
+		return "finish";
+	default:
+		return "running";
+	}
+}
+
+static void print_csv(void)
+{
+	int i;
+
+	printf("cpu,pid,start,end,slots,end_event,stolen_from\n");
+	for (i = 0; i < nr_segs; i++)
+		printf("%d,%u,%u,%u,%u,%s,%d\n", segs[i].cpu, segs[i].pid,
+		       segs[i].start, segs[i].end, segs[i].end - segs[i].start,
+		       end_name(segs[i].end_type), segs[i].stolen_from);
+}
+
+static void print_chart(int nr_cpus, uint32_t max_time, uint32_t max_pid)
+{
+	uint32_t *cell = calloc((size_t)nr_cpus * max_time, sizeof(uint32_t));
+	int width = snprintf(NULL, 0, "%u", max_pid > max_time ? max_pid : max_time) + 1;
+	uint32_t t;
+	int i, cpu;
+
+	for (i = 0; i < nr_segs; i++)
+		for (t = segs[i].start; t < segs[i].end && t < max_time; t++)
+			cell[(size_t)segs[i].cpu * max_time + t] = segs[i].pid;
+
+	printf("Time   |");
+	for (t = 0; t < max_time; t++)
+		printf("%*u", width, t);
+	printf("\n");
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+	{
+		printf("CPU %-3d|", cpu);
+		for (t = 0; t < max_time; t++)
+		{
+			uint32_t pid = cell[(size_t)cpu * max_time + t];
+
+			if (pid)
+				printf("%*u", width, pid);
+			else
+				printf("%*s", width, ".");
+		}
+		printf("\n");
+	}
+	free(cell);
+}
+
+int main(int argc, char *argv[])
+{
+	struct trace_header hdr;
+	struct trace_event ev;
+	struct run_state *run;
+	uint32_t max_time = 0, max_pid = 0;
+	int csv = 0, opt, cpu;
+	FILE *file;
+
+	while ((opt = getopt(argc, argv, "c")) != -1)
+	{
+		if (opt != 'c')
+		{
+			printf("Usage: trace-gantt [-c] trace-file\n");
+			return 1;
+		}
+		csv = 1;
+	}
+	if (optind != argc - 1)
+	{
+		printf("Usage: trace-gantt [-c] trace-file\n");
+		return 1;
+	}
+
+	file = fopen(argv[optind], "rb");
+	if (file == NULL)
+	{
+		printf("Cannot open %s\n", argv[optind]);
+		return 1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != TRACE_VERSION ||
+	    hdr.event_size != sizeof(struct trace_event))
+	{
+		printf("%s is not a scheduler trace\n", argv[optind]);
+		fclose(file);
+		return 1;
+	}
+
+	run = calloc(hdr.nr_cpus, sizeof(struct run_state));
+	for (cpu = 0; cpu < hdr.nr_cpus; cpu++)
+		run[cpu].stolen_from = -1;
+
+	/* Records of one CPU are in time order, so a per-CPU state is
+	 * enough even though CPUs are interleaved in the file */
+	while (fread(&ev, sizeof(ev), 1, file) == 1)
+	{
+		struct run_state *r;
+
+		if (ev.cpu >= hdr.nr_cpus)
+			continue;
+		r = &run[ev.cpu];
+		if (ev.time > max_time)
+			max_time = ev.time;
+		if (ev.pid > max_pid)
+			max_pid = ev.pid;
+		switch (ev.type)
+		{
+		case TRACE_STEAL:
+			r->stolen_from = ev.arg;
+			break;
+		case TRACE_DISPATCH:
+			if (r->pid)
+				add_segment(ev.cpu, r, ev.time, 0);
+			r->pid = ev.pid;
+			r->start = ev.time;
+			break;
+		case TRACE_PREEMPT:
+		case TRACE_FINISH:
+			if (r->pid == ev.pid)
+				add_segment(ev.cpu, r, ev.time, ev.type);
+			break;
+		}
+	}
+	fclose(file);
+	for (cpu = 0; cpu < hdr.nr_cpus; cpu++)
+		if (run[cpu].pid)
+			add_segment(cpu, &run[cpu], max_time + 1, 0);
+	free(run);
+
+	if (csv)
+		print_csv();
+	else
+		print_chart(hdr.nr_cpus, max_time + 1, max_pid);
+	free(segs);
+	return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Scheduler event trace, see trace.h
+ */
+
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_DRAIN_NS 1000000	// Writer period
+#define TRACE_WAIT_NS 10000	// Poll period of a CPU waiting on a full ring
+
+struct trace_ring *trace_rings;
+
+static FILE *trace_file;
+static int trace_nr_cpus;
+static int trace_stop;
+static pthread_t trace_writer;
+
+/* Write out the events published in [r] so far */
+static void trace_drain(struct trace_ring *r)
+{
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = r->tail;
+
+	while (tail != head)
+	{
+		uint32_t i = tail & (TRACE_RING_EVENTS - 1);
+		uint32_t n = head - tail;
+
+		/* Up to the end of the array, the rest on the next pass */
+		if (n > TRACE_RING_EVENTS - i)
+			n = TRACE_RING_EVENTS - i;
+		fwrite(&r->ev[i], sizeof(struct trace_event), n, trace_file);
+		tail += n;
+	}
+	/* The CPU may reuse the slots once tail moved past them */
+	__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void *trace_routine(void *arg)
+{
+	struct timespec period = {0, TRACE_DRAIN_NS};
+	int cpu;
+
+	while (!__atomic_load_n(&trace_stop, __ATOMIC_ACQUIRE))
+	{
+		nanosleep(&period, NULL);
+		for (cpu = 0; cpu <= trace_nr_cpus; cpu++)
+			trace_drain(&trace_rings[cpu]);
+	}
+	return NULL;
+}
+
+int trace_init(const char *path, int nr_cpus)
+{
+	struct trace_header hdr;
+	int cpu;
+
+	trace_file = fopen(path, "wb");
+	if (trace_file == NULL)
+		return -1;
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.nr_cpus = nr_cpus;
+	hdr.event_size = sizeof(struct trace_event);
+	fwrite(&hdr, sizeof(hdr), 1, trace_file);
+
+	/* One more for the loader */
+	trace_nr_cpus = nr_cpus;
+	trace_rings = aligned_alloc(64, sizeof(struct trace_ring) * (nr_cpus + 1));
+	for (cpu = 0; cpu <= nr_cpus; cpu++)
+	{
+		struct trace_ring *r = &trace_rings[cpu];
+
+		r->ev = calloc(TRACE_RING_EVENTS, sizeof(struct trace_event));
+		r->head = r->tail_cache = r->tail = 0;
+	}
+	trace_stop = 0;
+	pthread_create(&trace_writer, NULL, trace_routine, NULL);
+	return 0;
+}
+
+void trace_wait(struct trace_ring *r)
+{
+	struct timespec period = {0, TRACE_WAIT_NS};
+
+	while ((r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) ==
+	       r->head - TRACE_RING_EVENTS)
+		nanosleep(&period, NULL);
+}
+
+void trace_finish(void)
+{
+	int cpu;
+
+	if (trace_rings == NULL)
+		return;
+	__atomic_store_n(&trace_stop, 1, __ATOMIC_RELEASE);
+	pthread_join(trace_writer, NULL);
+	for (cpu = 0; cpu <= trace_nr_cpus; cpu++)
+	{
+		trace_drain(&trace_rings[cpu]);
+		free(trace_rings[cpu].ev);
+	}
+	free(trace_rings);
+	trace_rings = NULL;
+	fclose(trace_file);
+	trace_file = NULL;
+}